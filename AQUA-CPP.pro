@@ -1,18 +1,37 @@
 TEMPLATE = app
-CONFIG += console c++17
+CONFIG += console c++17 thread
 CONFIG -= app_bundle
 CONFIG -= qt
 
 SOURCES += \
+        batchexecutor.cpp \
+        blockexecutor.cpp \
+        client.cpp \
         compiler.cpp \
         executor.cpp \
+        generator.cpp \
         main.cpp \
         module.cpp \
+        profiler.cpp \
+        resultcache.cpp \
+        server.cpp \
+        stress.cpp \
+        table.cpp \
         utils.cpp
 
 HEADERS += \
+    batchexecutor.h \
+    blockexecutor.h \
+    client.h \
     compiler.h \
     executor.h \
+    generator.h \
     globals.h \
     module.h \
+    profiler.h \
+    resultcache.h \
+    server.h \
+    staticexecutor.h \
+    stress.h \
+    table.h \
     utils.h
@@ -0,0 +1,452 @@
+#include "batchexecutor.h"
+#include "executor.h"
+#include "globals.h"
+#include <stdexcept>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BATCH_X86
+#endif
+using namespace std;
+
+/*
+ * Packed transition entry:
+ * bits 0-1: move (0 = none, 1 = left, 2 = right)
+ * bit 2: new state is an end state
+ * bits 3-10: new symbol code
+ * bits 11-31: new state
+ */
+static constexpr uint32_t MISSING = UINT32_MAX;
+static constexpr uint32_t MAX_BATCH_STATES = 1u << 21;
+static constexpr size_t VECTOR_WIDTH = 16; // lane count is kept a multiple of this
+static constexpr size_t PASS_STEPS = 64; // most steps per lane group before finished lanes are collected
+static constexpr int32_t MAX_CHUNK = 1 << 30;
+static constexpr size_t WINDOW_PADDING = 16; // cells between two lanes' windows, one cache line
+
+static auto pack(const Transition& t, bool end) -> uint32_t {
+	if(t.new_state == NO_STATE) return MISSING;
+	uint32_t move = t.dir == LEFT ? 1 : (t.dir == RIGHT ? 2 : 0);
+	return move | (end ? 4u : 0u) | (static_cast<uint32_t>(t.new_symbol) << 3) | (t.new_state << 11);
+}
+
+BatchExecutor::BatchExecutor(Module& module, size_t lanes, size_t tape_size) :
+	m_table(Executor::prepare(module)), m_lanes((max(lanes, size_t(1)) + VECTOR_WIDTH - 1) / VECTOR_WIDTH * VECTOR_WIDTH),
+	m_tape_size(tape_size), m_isa(bestIsa()) {
+	if(m_tape_size < 4) {
+		throw runtime_error("BatchExecutor: Memory window must be at least 4 cells");
+	}
+	if(m_lanes * (m_tape_size + WINDOW_PADDING) >= static_cast<size_t>(INT32_MAX)) {
+		throw runtime_error("BatchExecutor: Too many lanes for this memory window");
+	}
+	if(m_table->state_count() > MAX_BATCH_STATES) {
+		throw runtime_error("BatchExecutor: Too many states");
+	}
+
+	const size_t symbols = m_table->symbol_count();
+	m_packed.resize(m_table->state_count() * symbols);
+	for(uint32_t s=0; s<m_table->state_count(); ++s) {
+		for(size_t c=0; c<symbols; ++c) {
+			const Transition& t = m_table->at(s, static_cast<uint8_t>(c));
+			m_packed[s * symbols + c] = pack(t, t.new_state != NO_STATE && m_table->isEndState(t.new_state));
+		}
+	}
+	m_blank = m_table->code(ZERO_CHAR);
+
+	m_state.resize(m_lanes);
+	m_head.resize(m_lanes);
+	m_lo.resize(m_lanes);
+	m_hi.resize(m_lanes);
+	m_min.resize(m_lanes);
+	m_max.resize(m_lanes);
+	m_remaining.resize(m_lanes);
+	m_info.resize(m_lanes);
+	m_tape.assign(m_lanes * (m_tape_size + WINDOW_PADDING), max(m_blank, 0));
+	for(size_t lane=0; lane<m_lanes; ++lane) {
+		m_lo[lane] = static_cast<int32_t>(lane * (m_tape_size + WINDOW_PADDING));
+		m_hi[lane] = m_lo[lane] + static_cast<int32_t>(m_tape_size) - 1;
+	}
+}
+
+auto BatchExecutor::bestIsa() -> BatchIsa {
+#ifdef BATCH_X86
+	if(__builtin_cpu_supports("avx512f")) return BATCH_AVX512;
+	if(__builtin_cpu_supports("avx2")) return BATCH_AVX2;
+#endif
+	return BATCH_SCALAR;
+}
+
+auto BatchExecutor::isaName(BatchIsa isa) -> const char* {
+	switch(isa) {
+	case BATCH_AVX512: return "avx512";
+	case BATCH_AVX2: return "avx2";
+	default: return "scalar";
+	}
+}
+
+auto BatchExecutor::load(size_t lane, size_t job_index, const BatchJob& job) -> bool {
+	const size_t len = job.mem.size();
+	if(m_blank < 0 || len == 0 || job.head_pos >= len || len + 2 > m_tape_size) return false;
+
+	// the memory sits in the middle of the window, so the head has room in both directions
+	const int32_t base = m_lo[lane] + static_cast<int32_t>((m_tape_size - len) / 2);
+	for(size_t i=0; i<len; ++i) {
+		int code = m_table->code(job.mem[i]);
+		if(code < 0) {
+			fill_n(&m_tape[static_cast<size_t>(base)], i, m_blank);
+			return false;
+		}
+		m_tape[static_cast<size_t>(base) + i] = code;
+	}
+
+	LaneInfo& info = m_info[lane];
+	info.job = job_index;
+	info.mem_begin = base;
+	info.mem_end = base + static_cast<int32_t>(len);
+	info.steps = 0;
+	info.chunk = static_cast<int32_t>(min(job.max_steps, static_cast<size_t>(MAX_CHUNK)));
+	info.budget_left = job.max_steps - static_cast<size_t>(info.chunk);
+
+	m_state[lane] = static_cast<int32_t>(m_table->start_state());
+	m_head[lane] = base + static_cast<int32_t>(job.head_pos);
+	m_min[lane] = m_head[lane];
+	m_max[lane] = m_head[lane];
+	m_remaining[lane] = info.chunk;
+	return true;
+}
+
+void BatchExecutor::idle(size_t lane) {
+	// no budget, the step functions leave the lane alone
+	m_state[lane] = 0;
+	m_head[lane] = m_lo[lane] + 1;
+	m_remaining[lane] = 0;
+}
+
+auto BatchExecutor::usedBegin(size_t lane) const -> int32_t {
+	return min(m_min[lane], m_info[lane].mem_begin);
+}
+
+auto BatchExecutor::usedEnd(size_t lane) const -> int32_t {
+	return max(m_max[lane] + 1, m_info[lane].mem_end);
+}
+
+void BatchExecutor::clear(size_t lane) {
+	fill(&m_tape[static_cast<size_t>(usedBegin(lane))], &m_tape[static_cast<size_t>(usedEnd(lane))], m_blank);
+}
+
+void BatchExecutor::moveLane(size_t from, size_t to) {
+	const int32_t shift = m_lo[to] - m_lo[from];
+	copy(&m_tape[static_cast<size_t>(usedBegin(from))], &m_tape[static_cast<size_t>(usedEnd(from))], &m_tape[static_cast<size_t>(usedBegin(from) + shift)]);
+	clear(from);
+	m_state[to] = m_state[from];
+	m_head[to] = m_head[from] + shift;
+	m_min[to] = m_min[from] + shift;
+	m_max[to] = m_max[from] + shift;
+	m_remaining[to] = m_remaining[from];
+	m_info[to] = m_info[from];
+	m_info[to].mem_begin += shift;
+	m_info[to].mem_end += shift;
+}
+
+auto BatchExecutor::collect(size_t lane, BatchResult& result) const -> size_t {
+	// the result covers the initial memory and every visited cell, just like Executor's memory
+	const LaneInfo& info = m_info[lane];
+	const int32_t begin = usedBegin(lane);
+	const int32_t end = usedEnd(lane);
+	result.mem.resize(static_cast<size_t>(end - begin));
+	for(int32_t c=begin; c<end; ++c) {
+		result.mem[static_cast<size_t>(c - begin)] = m_table->symbol(static_cast<uint8_t>(m_tape[static_cast<size_t>(c)]));
+	}
+	result.state = m_table->state_names()[static_cast<size_t>(m_state[lane])];
+	result.head_pos = static_cast<size_t>(m_head[lane] - begin);
+	return info.steps + static_cast<size_t>(info.chunk - m_remaining[lane]);
+}
+
+void BatchExecutor::runExecutor(const BatchJob& job, BatchResult& result, size_t steps) const {
+	// continues from result if steps have been taken already, else starts with the job
+	Executor e(m_table);
+	if(steps > 0) {
+		e.setMem(result.mem);
+		e.setHeadPos(result.head_pos);
+		e.setState(result.state);
+	} else {
+		e.setMem(job.mem);
+		e.setHeadPos(job.head_pos);
+	}
+
+	try {
+		result.steps = steps + e.run(job.max_steps - steps);
+		result.halted = result.steps > 0 && e.done();
+	} catch(runtime_error& err) {
+		result.error = err.what();
+	}
+	result.state = e.state();
+	result.mem = e.mem();
+	result.head_pos = e.headPos();
+}
+
+#ifdef BATCH_X86
+// one bit per lane of a group from the two masks of its halves
+__attribute__((target("avx2")))
+static inline auto laneBits(const __m256i* mask) -> unsigned {
+	return static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(mask[0])))
+		   | static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(mask[1]))) << 8;
+}
+
+__attribute__((target("avx2")))
+void BatchExecutor::stepAvx2(size_t group, size_t max_steps) {
+	const int* packed = reinterpret_cast<const int*>(m_packed.data());
+	const int32_t* tape = m_tape.data();
+	const __m256i symbols = _mm256_set1_epi32(static_cast<int>(m_table->symbol_count()));
+	const __m256i missing = _mm256_set1_epi32(-1);
+	const __m256i bytes = _mm256_set1_epi32(0xFF);
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256i two = _mm256_set1_epi32(2);
+	const __m256i three = _mm256_set1_epi32(3);
+	const __m256i four = _mm256_set1_epi32(4);
+	alignas(32) int32_t heads[VECTOR_WIDTH];
+	alignas(32) int32_t written[VECTOR_WIDTH];
+
+	// the group is stepped as two halves of 8 lanes, so their gathers overlap
+	__m256i state[2], head[2], rem[2], lo[2], hi[2], edge_lo[2], edge_hi[2], live[2];
+	for(size_t h=0; h<2; ++h) {
+		const size_t lane = group + 8 * h;
+		state[h] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&m_state[lane]));
+		head[h] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&m_head[lane]));
+		rem[h] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&m_remaining[lane]));
+		lo[h] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&m_min[lane]));
+		hi[h] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&m_max[lane]));
+		edge_lo[h] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&m_lo[lane]));
+		edge_hi[h] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&m_hi[lane]));
+		live[h] = _mm256_cmpgt_epi32(rem[h], zero);
+	}
+	// lanes that stop are masked out, the others go on until half of the group is done
+	const int keep = __builtin_popcount(laneBits(live)) / 2;
+
+	for(size_t k=0; k<max_steps; ++k) {
+		__m256i entry[2], cell[2];
+		for(size_t h=0; h<2; ++h) {
+			cell[h] = _mm256_i32gather_epi32(tape, head[h], 4);
+			__m256i slot = _mm256_add_epi32(_mm256_mullo_epi32(state[h], symbols), cell[h]);
+			entry[h] = _mm256_mask_i32gather_epi32(missing, packed, slot, live[h], 4);
+			live[h] = _mm256_andnot_si256(_mm256_cmpeq_epi32(entry[h], missing), live[h]); // faulting lanes don't step
+			_mm256_store_si256(reinterpret_cast<__m256i*>(&heads[8 * h]), head[h]);
+			// lanes that don't step write back their own cell, so the loop below has no branches
+			__m256i symbol = _mm256_and_si256(_mm256_srli_epi32(entry[h], 3), bytes);
+			_mm256_store_si256(reinterpret_cast<__m256i*>(&written[8 * h]), _mm256_blendv_epi8(cell[h], symbol, live[h]));
+		}
+		if(laneBits(live) == 0) break;
+		for(size_t j=0; j<VECTOR_WIDTH; ++j) {
+			m_tape[static_cast<size_t>(heads[j])] = written[j];
+		}
+
+		for(size_t h=0; h<2; ++h) {
+			__m256i move = _mm256_and_si256(entry[h], _mm256_and_si256(live[h], three));
+			head[h] = _mm256_add_epi32(head[h], _mm256_sub_epi32(_mm256_cmpeq_epi32(move, one), _mm256_cmpeq_epi32(move, two)));
+			state[h] = _mm256_blendv_epi8(state[h], _mm256_srli_epi32(entry[h], 11), live[h]);
+			lo[h] = _mm256_min_epi32(lo[h], head[h]);
+			hi[h] = _mm256_max_epi32(hi[h], head[h]);
+			rem[h] = _mm256_add_epi32(rem[h], live[h]); // live lanes are -1
+
+			__m256i stop = _mm256_cmpeq_epi32(_mm256_and_si256(entry[h], four), four);
+			stop = _mm256_or_si256(stop, _mm256_cmpeq_epi32(rem[h], zero));
+			stop = _mm256_or_si256(stop, _mm256_cmpeq_epi32(head[h], edge_lo[h]));
+			stop = _mm256_or_si256(stop, _mm256_cmpeq_epi32(head[h], edge_hi[h]));
+			live[h] = _mm256_andnot_si256(stop, live[h]);
+		}
+		if(__builtin_popcount(laneBits(live)) <= keep) break;
+	}
+
+	for(size_t h=0; h<2; ++h) {
+		const size_t lane = group + 8 * h;
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(&m_state[lane]), state[h]);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(&m_head[lane]), head[h]);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(&m_remaining[lane]), rem[h]);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(&m_min[lane]), lo[h]);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(&m_max[lane]), hi[h]);
+	}
+}
+
+// some versions of GCC's AVX-512 headers trip -Wmaybe-uninitialized on their own placeholder values
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+__attribute__((target("avx512f")))
+void BatchExecutor::stepAvx512(size_t group, size_t max_steps) {
+	const int* packed = reinterpret_cast<const int*>(m_packed.data());
+	int32_t* tape = m_tape.data();
+	const __m512i symbols = _mm512_set1_epi32(static_cast<int>(m_table->symbol_count()));
+	const __m512i missing = _mm512_set1_epi32(-1);
+	const __m512i bytes = _mm512_set1_epi32(0xFF);
+	const __m512i zero = _mm512_setzero_si512();
+	const __m512i one = _mm512_set1_epi32(1);
+	const __m512i two = _mm512_set1_epi32(2);
+	const __m512i three = _mm512_set1_epi32(3);
+	const __m512i four = _mm512_set1_epi32(4);
+
+	__m512i state = _mm512_loadu_si512(&m_state[group]);
+	__m512i head = _mm512_loadu_si512(&m_head[group]);
+	__m512i rem = _mm512_loadu_si512(&m_remaining[group]);
+	__m512i lo = _mm512_loadu_si512(&m_min[group]);
+	__m512i hi = _mm512_loadu_si512(&m_max[group]);
+	const __m512i edge_lo = _mm512_loadu_si512(&m_lo[group]);
+	const __m512i edge_hi = _mm512_loadu_si512(&m_hi[group]);
+
+	// lanes that stop are masked out, the others go on until half of the group is done
+	__mmask16 live = _mm512_cmpgt_epi32_mask(rem, zero);
+	const __mmask16 started = live;
+	const int keep = __builtin_popcount(live) / 2;
+
+	// the cells left of, under and right of the head stay in registers, so the next
+	// transition doesn't wait for the tape, which only sees cells leaving this window
+	__m512i left = _mm512_mask_i32gather_epi32(zero, live, _mm512_sub_epi32(head, one), tape, 4);
+	__m512i cur = _mm512_mask_i32gather_epi32(zero, live, head, tape, 4);
+	__m512i right = _mm512_mask_i32gather_epi32(zero, live, _mm512_add_epi32(head, one), tape, 4);
+
+	for(size_t k=0; k<max_steps; ++k) {
+		__m512i slot = _mm512_add_epi32(_mm512_mullo_epi32(state, symbols), cur);
+		__m512i entry = _mm512_mask_i32gather_epi32(missing, live, slot, packed, 4);
+		live &= _mm512_cmpneq_epi32_mask(entry, missing); // faulting lanes don't step
+		if(live == 0) break;
+
+		__m512i symbol = _mm512_and_si512(_mm512_srli_epi32(entry, 3), bytes);
+		__m512i move = _mm512_and_si512(entry, three);
+		const __mmask16 go_left = live & _mm512_cmpeq_epi32_mask(move, one);
+		const __mmask16 go_right = live & _mm512_cmpeq_epi32_mask(move, two);
+		const __mmask16 moved = go_left | go_right;
+
+		// a move pushes the cell on the other side out of the window and pulls the next one in,
+		// unless the head reached the edge, then the lane stops and that cell isn't needed
+		__m512i out_addr = _mm512_mask_blend_epi32(go_right, _mm512_add_epi32(head, one), _mm512_sub_epi32(head, one));
+		_mm512_mask_i32scatter_epi32(tape, moved, out_addr, _mm512_mask_blend_epi32(go_right, right, left), 4);
+
+		head = _mm512_mask_sub_epi32(head, go_left, head, one);
+		head = _mm512_mask_add_epi32(head, go_right, head, one);
+		const __mmask16 inside = moved & _mm512_cmpneq_epi32_mask(head, edge_lo) & _mm512_cmpneq_epi32_mask(head, edge_hi);
+		__m512i in_addr = _mm512_mask_blend_epi32(go_right, _mm512_sub_epi32(head, one), _mm512_add_epi32(head, one));
+		__m512i enter = _mm512_mask_i32gather_epi32(zero, inside, in_addr, tape, 4);
+
+		__m512i new_cur = _mm512_mask_mov_epi32(cur, live & ~moved, symbol);
+		new_cur = _mm512_mask_mov_epi32(new_cur, go_right, right);
+		new_cur = _mm512_mask_mov_epi32(new_cur, go_left, left);
+		left = _mm512_mask_mov_epi32(_mm512_mask_mov_epi32(left, go_right, symbol), go_left, enter);
+		right = _mm512_mask_mov_epi32(_mm512_mask_mov_epi32(right, go_left, symbol), go_right, enter);
+		cur = new_cur;
+
+		state = _mm512_mask_srli_epi32(state, live, entry, 11);
+		lo = _mm512_min_epi32(lo, head);
+		hi = _mm512_max_epi32(hi, head);
+		rem = _mm512_mask_sub_epi32(rem, live, rem, one);
+
+		__mmask16 stop = _mm512_test_epi32_mask(entry, four);
+		stop |= _mm512_cmpeq_epi32_mask(rem, zero);
+		stop |= _mm512_cmpeq_epi32_mask(head, edge_lo);
+		stop |= _mm512_cmpeq_epi32_mask(head, edge_hi);
+		live &= ~stop;
+		if(__builtin_popcount(live) <= keep) break;
+	}
+
+	// windows at the edge reach one cell outside of the lane
+	_mm512_mask_i32scatter_epi32(tape, started, head, cur, 4);
+	_mm512_mask_i32scatter_epi32(tape, started & _mm512_cmpneq_epi32_mask(head, edge_lo), _mm512_sub_epi32(head, one), left, 4);
+	_mm512_mask_i32scatter_epi32(tape, started & _mm512_cmpneq_epi32_mask(head, edge_hi), _mm512_add_epi32(head, one), right, 4);
+	_mm512_storeu_si512(&m_state[group], state);
+	_mm512_storeu_si512(&m_head[group], head);
+	_mm512_storeu_si512(&m_remaining[group], rem);
+	_mm512_storeu_si512(&m_min[group], lo);
+	_mm512_storeu_si512(&m_max[group], hi);
+}
+#pragma GCC diagnostic pop
+#endif
+
+void BatchExecutor::run(const vector<BatchJob>& jobs, vector<BatchResult>& results) {
+	results.assign(jobs.size(), BatchResult());
+	const size_t symbols = m_table->symbol_count();
+	size_t next = 0;
+
+	// puts the next job that can run in a lane into the given lane, finishes the others right away
+	auto refill = [&](size_t lane) -> bool {
+		while(next < jobs.size()) {
+			const size_t j = next++;
+			if(jobs[j].max_steps == 0) {
+				results[j].state = m_table->state_names()[m_table->start_state()];
+				results[j].mem = jobs[j].mem;
+				results[j].head_pos = jobs[j].head_pos;
+				continue;
+			}
+			// without vector units the Executor's own loop is faster than a lane
+			if(m_isa != BATCH_SCALAR && load(lane, j, jobs[j])) return true;
+			if(jobs[j].head_pos >= jobs[j].mem.size()) {
+				results[j].error = "BatchExecutor: Head position outside of memory";
+				continue;
+			}
+			if(m_isa != BATCH_SCALAR) ++m_fallbacks;
+			runExecutor(jobs[j], results[j]);
+		}
+		return false;
+	};
+
+	auto finish = [&](size_t lane, bool fault, bool halted) {
+		BatchResult& result = results[m_info[lane].job];
+		size_t steps = collect(lane, result);
+		if(fault) {
+			result.error = "Executor: No rule found for state " + result.state + " and char " + result.mem[result.head_pos];
+		} else {
+			result.steps = steps;
+			result.halted = halted;
+		}
+	};
+
+	size_t active = 0;
+	while(active < m_lanes && refill(active)) ++active;
+	for(size_t lane=active; lane<m_lanes; ++lane) idle(lane);
+
+	while(active > 0) {
+		for(size_t group=0; group<active; group+=VECTOR_WIDTH) {
+#ifdef BATCH_X86
+			if(m_isa == BATCH_AVX512) stepAvx512(group, PASS_STEPS);
+			else stepAvx2(group, PASS_STEPS);
+#endif
+
+			// collect the group's finished lanes while they are in cache, refill them or move the last active lane into the gap
+			for(size_t lane=group; lane<min(group + VECTOR_WIDTH, active); ) {
+				LaneInfo& info = m_info[lane];
+				const uint32_t state = static_cast<uint32_t>(m_state[lane]);
+				const bool stepped = info.steps > 0 || m_remaining[lane] != info.chunk;
+
+				if(m_remaining[lane] == 0 && info.budget_left > 0 && !(stepped && m_table->isEndState(state))) {
+					info.steps += static_cast<size_t>(info.chunk);
+					info.chunk = static_cast<int32_t>(min(info.budget_left, static_cast<size_t>(MAX_CHUNK)));
+					info.budget_left -= static_cast<size_t>(info.chunk);
+					m_remaining[lane] = info.chunk;
+				}
+
+				const int32_t head = m_head[lane];
+				if(stepped && m_table->isEndState(state)) {
+					finish(lane, false, true);
+				} else if(m_remaining[lane] == 0) {
+					finish(lane, false, false);
+				} else if(head == m_lo[lane] || head == m_hi[lane]) {
+					// the memory window is too small, continue outside of the batch
+					BatchResult& result = results[info.job];
+					++m_fallbacks;
+					runExecutor(jobs[info.job], result, collect(lane, result));
+				} else if(m_packed[state * symbols + static_cast<size_t>(m_tape[static_cast<size_t>(head)])] == MISSING) {
+					finish(lane, true, false);
+				} else {
+					++lane;
+					continue;
+				}
+
+				clear(lane);
+				if(refill(lane)) {
+					++lane;
+					continue;
+				}
+				--active;
+				if(lane != active) moveLane(active, lane);
+				idle(active);
+			}
+		}
+	}
+}
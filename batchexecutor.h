@@ -0,0 +1,104 @@
+#ifndef BATCHEXECUTOR_H
+#define BATCHEXECUTOR_H
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "module.h"
+#include "table.h"
+
+static constexpr size_t DEFAULT_BATCH_LANES = 256;
+static constexpr size_t DEFAULT_BATCH_TAPE = 1024;
+
+struct BatchJob {
+	std::string mem;
+	size_t head_pos = 0;
+	size_t max_steps = SIZE_MAX;
+};
+
+struct BatchResult {
+	std::string state {};
+	std::string mem {};
+	size_t head_pos = 0;
+	size_t steps = 0;
+	bool halted = false; // an end state was reached, else max_steps ran out
+	std::string error {}; // the message Executor::run would have thrown, steps is not set then
+};
+
+enum BatchIsa {
+	BATCH_SCALAR,
+	BATCH_AVX2,
+	BATCH_AVX512
+};
+
+/*
+ * Runs one machine on many memories at once. The executions are kept as
+ * structure of arrays (state, head, visited range, budget per lane, the
+ * memories in one flat array of symbol codes) and stepped together with
+ * gathers on a packed transition table. Lanes that halt, fault or run out of
+ * budget are masked while the rest of their group goes on, once half of a
+ * group stopped they are refilled with the next job or compacted away. Jobs
+ * that don't fit into a lane's memory window are handed to a normal Executor
+ * (lanes whose head reaches the edge continue there from where they are), so
+ * all results match Executor::run. Without AVX2 every job is run by the
+ * Executor, stepping lanes one by one is slower than its own loop.
+ */
+class BatchExecutor {
+	std::shared_ptr<const Table> m_table; // prepared once for all Executor fallbacks
+	std::vector<uint32_t> m_packed {}; // see pack() in batchexecutor.cpp
+	int m_blank = -1; // symbol code of ZERO_CHAR
+	size_t m_lanes;
+	size_t m_tape_size;
+	BatchIsa m_isa;
+	size_t m_fallbacks = 0;
+
+	// lane data, int32 so they fit vector registers
+	std::vector<int32_t> m_state {};
+	std::vector<int32_t> m_head {}; // index into m_tape
+	std::vector<int32_t> m_lo {}; // first and last cell of the lane's memory window
+	std::vector<int32_t> m_hi {};
+	std::vector<int32_t> m_min {}; // visited range
+	std::vector<int32_t> m_max {};
+	std::vector<int32_t> m_remaining {}; // steps left in the current budget chunk
+	std::vector<int32_t> m_tape {}; // windows are padded apart, so the lanes of a group don't share cache sets
+
+	struct LaneInfo {
+		size_t job;
+		int32_t mem_begin; // where the job's memory starts in m_tape
+		int32_t mem_end;
+		size_t steps; // steps of completed budget chunks
+		int32_t chunk; // size of the current budget chunk
+		size_t budget_left; // budget not yet handed out as chunk
+	};
+	std::vector<LaneInfo> m_info {};
+
+	// steps the VECTOR_WIDTH lanes from group on, at most max_steps each
+	void stepAvx2(size_t group, size_t max_steps);
+	void stepAvx512(size_t group, size_t max_steps);
+
+	auto load(size_t lane, size_t job_index, const BatchJob& job) -> bool;
+	void idle(size_t lane);
+	// cells outside of [usedBegin, usedEnd) are blank in every window
+	auto usedBegin(size_t lane) const -> int32_t;
+	auto usedEnd(size_t lane) const -> int32_t;
+	void clear(size_t lane);
+	void moveLane(size_t from, size_t to);
+	auto collect(size_t lane, BatchResult& result) const -> size_t;
+	void runExecutor(const BatchJob& job, BatchResult& result, size_t steps = 0) const;
+
+public:
+	BatchExecutor(Module& module, size_t lanes = DEFAULT_BATCH_LANES, size_t tape_size = DEFAULT_BATCH_TAPE);
+
+	static auto bestIsa() -> BatchIsa;
+	static auto isaName(BatchIsa isa) -> const char*;
+	void setIsa(BatchIsa isa) {m_isa = std::min(isa, bestIsa());}
+
+	// number of jobs that had to be run by the Executor fallback
+	auto fallbacks() const -> size_t {return m_fallbacks;}
+
+	void run(const std::vector<BatchJob>& jobs, std::vector<BatchResult>& results);
+};
+
+#endif // BATCHEXECUTOR_H
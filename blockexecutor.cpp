@@ -0,0 +1,240 @@
+#include "blockexecutor.h"
+#include "globals.h"
+#include <stdexcept>
+#include <algorithm>
+using namespace std;
+
+BlockExecutor::BlockExecutor(Module& module, size_t block_size, size_t cache_capacity) :
+	m_table(module), m_block_size(block_size), m_cache_capacity(cache_capacity), m_state(m_table.start_state()) {
+	if(m_block_size == 0) {
+		throw runtime_error("BlockExecutor: Block size must not be 0");
+	}
+}
+
+void BlockExecutor::setMem(const string& mem) {
+	m_mem = mem;
+}
+
+void BlockExecutor::setHeadPos(size_t head_pos) {
+	m_head_pos = head_pos;
+}
+
+void BlockExecutor::setState(const string& state) {
+	auto it = find(m_table.state_names().begin(), m_table.state_names().end(), state);
+	if(it == m_table.state_names().end()) {
+		throw runtime_error("BlockExecutor: Unknown state " + state);
+	}
+	m_state = static_cast<uint32_t>(it - m_table.state_names().begin());
+}
+
+auto BlockExecutor::simulate(uint32_t state, string block, long offset, size_t max_steps) const -> MacroResult {
+	MacroResult result;
+	result.min_offset = offset;
+	result.max_offset = offset;
+	result.kind = BUDGET;
+
+	const long size = static_cast<long>(block.size());
+	while(result.steps < max_steps) {
+		char& cell = block[static_cast<size_t>(offset)];
+		int code = m_table.code(cell);
+		if(code < 0 || m_table.at(state, static_cast<uint8_t>(code)).new_state == NO_STATE) {
+			result.kind = FAULT;
+			break;
+		}
+
+		const Transition& t = m_table.at(state, static_cast<uint8_t>(code));
+		state = t.new_state;
+		cell = m_table.symbol(t.new_symbol);
+		if(t.dir == LEFT) --offset;
+		else if(t.dir == RIGHT) ++offset;
+		result.min_offset = min(result.min_offset, offset);
+		result.max_offset = max(result.max_offset, offset);
+		++result.steps;
+
+		if(m_table.isEndState(state)) {
+			result.kind = HALT;
+			break;
+		}
+		if(offset < 0) {
+			result.kind = EXIT_LEFT;
+			break;
+		}
+		if(offset >= size) {
+			result.kind = EXIT_RIGHT;
+			break;
+		}
+	}
+
+	result.block = move(block);
+	result.state = state;
+	result.offset = offset;
+	return result;
+}
+
+auto BlockExecutor::lookup(uint32_t state, const string& block, bool from_left, size_t max_steps) -> MacroResult {
+	string key = block;
+	key.append(reinterpret_cast<const char*>(&state), sizeof(state));
+	key.push_back(from_left ? '<' : '>');
+
+	auto it = m_cache.find(key);
+	if(it != m_cache.end() && it->second.steps <= max_steps) {
+		++m_cache_hits;
+		return it->second;
+	}
+
+	++m_cache_misses;
+	MacroResult result = simulate(state, block, from_left ? 0 : static_cast<long>(block.size()) - 1, max_steps);
+
+	// results that depend on the budget or end in a fault are not reusable
+	if(result.kind != BUDGET && result.kind != FAULT) {
+		if(m_cache.size() >= m_cache_capacity) m_cache.clear();
+		m_cache[key] = result;
+	}
+	return result;
+}
+
+void BlockExecutor::push(vector<Run>& stack, const string& block, size_t count) {
+	if(!stack.empty() && stack.back().block == block) {
+		stack.back().count += count;
+	} else {
+		stack.push_back({block, count});
+	}
+}
+
+auto BlockExecutor::run(size_t max_steps) -> size_t {
+	const size_t k = m_block_size;
+	const long lk = static_cast<long>(k);
+	const string blank(k, ZERO_CHAR);
+
+	if(m_head_pos >= m_mem.size()) {
+		throw runtime_error("BlockExecutor: Head position outside of memory");
+	}
+
+	// cut the memory into blocks, the block under the head goes on top of the right stack
+	vector<Run> left;
+	vector<Run> right;
+	const size_t head_block = m_head_pos / k;
+	const size_t block_count = (m_mem.size() + k - 1) / k;
+	string padded = m_mem; // the last block is filled up with blanks
+	padded.resize(block_count * k, ZERO_CHAR);
+	for(size_t b=0; b<head_block; ++b) {
+		push(left, padded.substr(b * k, k), 1);
+	}
+	for(size_t b=block_count; b-- > head_block; ) {
+		push(right, padded.substr(b * k, k), 1);
+	}
+	if(right.back().count > 1) { // the head block must be on its own
+		string head_block_content = right.back().block;
+		--right.back().count;
+		right.push_back({head_block_content, 1});
+	}
+
+	// the head sits at the boundary p, facing right (block [p, p+k)) or left (block [p-k, p))
+	long p = static_cast<long>(head_block * k);
+	bool facing_right = true;
+	long entry_offset = static_cast<long>(m_head_pos % k); // only the first block is entered in the middle
+	bool first = true;
+
+	// the executor grows the memory over every visited cell, keep track of that range
+	long min_visited = min(0L, static_cast<long>(m_head_pos));
+	long max_visited = max(static_cast<long>(m_mem.size()) - 1, static_cast<long>(m_head_pos));
+
+	long head = 0;
+	size_t steps = 0;
+	bool inside = false;
+	bool fault = false;
+
+	while(steps < max_steps) {
+		vector<Run>& facing = facing_right ? right : left;
+		vector<Run>& other = facing_right ? left : right;
+		if(facing.empty()) facing.push_back({blank, 1});
+
+		Run& run = facing.back();
+		const long block_start = facing_right ? p : p - lk;
+		const size_t remaining = max_steps - steps;
+
+		MacroResult r = first ? simulate(m_state, run.block, entry_offset, remaining) : lookup(m_state, run.block, facing_right, remaining);
+		bool crosses = facing_right ? r.kind == EXIT_RIGHT : r.kind == EXIT_LEFT;
+
+		// cross a whole run of identical blocks if the machine comes out in the state it entered with
+		if(!first && crosses && r.state == m_state && run.count > 1) {
+			size_t count = min(run.count, remaining / r.steps);
+			if(count > 1) {
+				long span = static_cast<long>(count - 1) * lk;
+				if(facing_right) {
+					min_visited = min(min_visited, block_start + r.min_offset);
+					max_visited = max(max_visited, block_start + span + r.max_offset);
+					p += static_cast<long>(count) * lk;
+				} else {
+					min_visited = min(min_visited, block_start - span + r.min_offset);
+					max_visited = max(max_visited, block_start + r.max_offset);
+					p -= static_cast<long>(count) * lk;
+				}
+
+				steps += count * r.steps;
+				if(run.count == count) facing.pop_back();
+				else run.count -= count;
+				push(other, r.block, count);
+				continue;
+			}
+		}
+		first = false;
+
+		// take a single block off the run and handle it
+		if(run.count == 1) facing.pop_back();
+		else --run.count;
+
+		steps += r.steps;
+		min_visited = min(min_visited, block_start + r.min_offset);
+		max_visited = max(max_visited, block_start + r.max_offset);
+		m_state = r.state;
+
+		if(r.kind == EXIT_RIGHT) {
+			push(left, r.block, 1);
+			p = block_start + lk;
+			facing_right = true;
+			continue;
+		}
+		if(r.kind == EXIT_LEFT) {
+			push(right, r.block, 1);
+			p = block_start;
+			facing_right = false;
+			continue;
+		}
+
+		// the run stops inside this block, put it back in front of the head
+		push(right, r.block, 1);
+		p = block_start;
+		facing_right = true;
+		head = block_start + r.offset;
+		inside = true;
+		fault = r.kind == FAULT;
+		break;
+	}
+	// stopped at a block boundary (or never started), the head is on the cell next to it
+	if(!inside) head = first ? static_cast<long>(m_head_pos) : (facing_right ? p : p - 1);
+
+	// turn the stacks back into memory, cells outside the stacks are blank
+	const long lo = min_visited;
+	const long hi = max_visited;
+	string mem(static_cast<size_t>(hi - lo + 1), ZERO_CHAR);
+	long pos = p;
+	for(auto& run : left) pos -= static_cast<long>(run.count) * lk;
+	auto copy = [&](const Run& run) {
+		long run_end = pos + static_cast<long>(run.count) * lk;
+		for(long c = max(pos, lo); c < min(run_end, hi + 1); ++c) {
+			mem[static_cast<size_t>(c - lo)] = run.block[static_cast<size_t>((c - pos) % lk)];
+		}
+		pos = run_end;
+	};
+	for_each(left.begin(), left.end(), copy); // the bottom of the left stack is the leftmost block
+	for_each(right.rbegin(), right.rend(), copy); // the top of the right stack is the leftmost block
+
+	m_mem = move(mem);
+	m_head_pos = static_cast<size_t>(head - lo);
+
+	if(fault) {
+		throw runtime_error("BlockExecutor: No rule found for state " + m_table.state_names()[m_state] + " and char " + m_mem[m_head_pos]);
+	}
+	return steps;
+}
@@ -0,0 +1,82 @@
+#ifndef BLOCKEXECUTOR_H
+#define BLOCKEXECUTOR_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "module.h"
+#include "table.h"
+
+static constexpr size_t DEFAULT_BLOCK_SIZE = 8;
+static constexpr size_t DEFAULT_BLOCK_CACHE = 1 << 16;
+
+/*
+ * Executes a machine on blocks of block_size cells instead of single cells.
+ * What happens to a block when it is entered from one side in some state is
+ * simulated once and memoized, later visits of the same block apply the result
+ * in one go. Runs of identical blocks are stored as (block, count) and crossed
+ * as a whole if the machine leaves each of them on the other side in the state
+ * it entered with. Step counts and the final memory match Executor exactly.
+ */
+class BlockExecutor {
+	enum ResultKind {
+		EXIT_LEFT,
+		EXIT_RIGHT,
+		HALT, // an end state was reached
+		BUDGET, // the step budget ran out inside the block
+		FAULT // no rule for the current state and symbol
+	};
+
+	struct MacroResult {
+		std::string block {};
+		uint32_t state = 0;
+		ResultKind kind = FAULT;
+		size_t steps = 0;
+		long offset = 0; // head position relative to the block start
+		long min_offset = 0; // visited range relative to the block start
+		long max_offset = 0;
+	};
+
+	struct Run {
+		std::string block;
+		size_t count;
+	};
+
+	Table m_table;
+	size_t m_block_size;
+	size_t m_cache_capacity;
+	std::unordered_map<std::string, MacroResult> m_cache {};
+
+	uint32_t m_state = 0;
+	std::string m_mem {};
+	size_t m_head_pos = 0;
+
+	size_t m_cache_hits = 0;
+	size_t m_cache_misses = 0;
+
+	auto simulate(uint32_t state, std::string block, long offset, size_t max_steps) const -> MacroResult;
+	auto lookup(uint32_t state, const std::string& block, bool from_left, size_t max_steps) -> MacroResult;
+	static void push(std::vector<Run>& stack, const std::string& block, size_t count);
+
+public:
+	BlockExecutor(Module& module, size_t block_size = DEFAULT_BLOCK_SIZE, size_t cache_capacity = DEFAULT_BLOCK_CACHE);
+
+	void setMem(const std::string& mem);
+	void setHeadPos(size_t head_pos);
+	// the cache stays valid, so one BlockExecutor can run many memories
+	void setState(const std::string& state);
+
+	auto state() const -> const std::string& {return m_table.state_names()[m_state];}
+	auto mem() const -> const std::string& {return m_mem;}
+	auto headPos() const -> size_t {return m_head_pos;}
+	auto done() const -> bool {return m_table.isEndState(m_state);}
+
+	auto cache_hits() const -> size_t {return m_cache_hits;}
+	auto cache_misses() const -> size_t {return m_cache_misses;}
+
+	// runs until an end state is reached or max_steps are done, returns the number of steps taken.
+	// the head has to be on a cell of the memory
+	auto run(size_t max_steps = SIZE_MAX) -> size_t;
+};
+
+#endif // BLOCKEXECUTOR_H
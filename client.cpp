@@ -0,0 +1,74 @@
+#include "client.h"
+#include "utils.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+using namespace std;
+
+Client::Client(const string& socket_path) {
+	sockaddr_un address {};
+	address.sun_family = AF_UNIX;
+	if(socket_path.size() >= sizeof(address.sun_path)) {
+		throw runtime_error("Client: Socket path too long: " + socket_path);
+	}
+	strcpy(address.sun_path, socket_path.c_str());
+
+	m_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(m_fd < 0 || connect(m_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+		throw runtime_error("Client: Could not connect to " + socket_path + ": " + strerror(errno));
+	}
+}
+
+Client::~Client() {
+	if(m_fd >= 0) close(m_fd);
+}
+
+auto Client::pipe(istream& in, ostream& out) -> size_t {
+	// send from a second thread, so neither side can block the other with full buffers, it has a
+	// descriptor of its own, as it is left behind if it still waits for input when the server closes
+	int send_fd = dup(m_fd);
+	if(send_fd < 0) {
+		throw runtime_error("Client: Could not duplicate the socket: " + string(strerror(errno)));
+	}
+	auto sent = make_shared<promise<void>>();
+	future<void> sender_done = sent->get_future();
+	thread sender([&in, send_fd, sent] {
+		string batch;
+		string line;
+		while(getline(in, line)) {
+			batch += line;
+			batch.push_back('\n');
+			if(batch.size() >= (1 << 16) || in.rdbuf()->in_avail() <= 0) {
+				if(!Utils::sendAll(send_fd, batch)) break;
+				batch.clear();
+			}
+		}
+		Utils::sendAll(send_fd, batch);
+		shutdown(send_fd, SHUT_WR); // the server answers everything that is left and closes
+		close(send_fd);
+		sent->set_value();
+	});
+
+	size_t answers = 0;
+	char chunk[1 << 16];
+	for(;;) {
+		ssize_t count = read(m_fd, chunk, sizeof(chunk));
+		if(count <= 0) break;
+		out.write(chunk, count);
+		answers += static_cast<size_t>(count_if(chunk, chunk + count, [](char c) {return c == '\n';}));
+	}
+	out.flush();
+
+	// nothing more will be answered, a sender that is still sending fails now, one waiting for input is not waited for
+	shutdown(m_fd, SHUT_RDWR);
+	if(sender_done.wait_for(SENDER_GRACE) == future_status::ready) sender.join();
+	else sender.detach();
+	return answers;
+}
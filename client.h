@@ -0,0 +1,28 @@
+#ifndef CLIENT_H
+#define CLIENT_H
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+static constexpr std::chrono::milliseconds SENDER_GRACE {100}; // how long pipe() waits for the sender after the server closed
+
+/*
+ * Talks to a Server: sends request lines and prints the answers, which come
+ * back one line per request in the same order.
+ */
+class Client {
+	int m_fd = -1;
+
+public:
+	explicit Client(const std::string& socket_path);
+	~Client();
+	Client(const Client&) = delete;
+	auto operator=(const Client&) -> Client& = delete;
+
+	// sends every line of in while the answers are already printed to out, returns the number of answers
+	// once the server closes the connection, if in still blocks then it is left to a detached thread, so it has to outlive the client (like cin)
+	auto pipe(std::istream& in, std::ostream& out) -> size_t;
+};
+
+#endif // CLIENT_H
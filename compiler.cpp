@@ -2,10 +2,13 @@
 #include "utils.h"
 #include "globals.h"
 #include "module.h"
+#include "table.h"
+#include "profiler.h"
 #include <stdexcept>
 #include <iostream>
 #include <chrono>
 #include <algorithm>
+#include <unordered_set>
 using namespace std;
 
 auto Compiler::isWhitespace(char c) -> bool {
@@ -29,13 +32,20 @@ void printRules(const vector<Rule>& rules) {
 	}
 }
 
-auto getModuleIndex(vector<pair<Module, size_t>>& module_list, const string& name) -> size_t {
+// adds one rule per symbol of the alphabet. new_char == '\0' writes back the symbol that was read
+void addRules(vector<Rule>& rules, const string& alphabet, const string& old_state, const string& new_state, MoveDir dir, char new_char = '\0') {
+	for(char c : alphabet) {
+		rules.emplace_back(old_state, c, new_state, new_char == '\0' ? c : new_char, dir);
+	}
+}
+
+auto getModuleIndex(vector<pair<Module, size_t>>& module_list, string_view name) -> size_t {
 	size_t index = 0;
 	for(; index < module_list.size(); ++index) {
 		if(module_list[index].first.name() == name) break;
 	}
 	if(index >= module_list.size()) {
-		throw runtime_error("Compiler: Module " + name + " not loaded!");
+		throw runtime_error("Compiler: Module " + string(name) + " not loaded!");
 	}
 	return index;
 }
@@ -51,8 +61,9 @@ void getModuleBindings(Module& module, const string& binding_string, const strin
 	}
 
 	// split binding string
-	vector<string> binding_string_tokens {};
-	Utils::split(binding_string, " ", binding_string_tokens);
+	vector<string_view> split_tokens {};
+	Utils::split(binding_string, ' ', split_tokens);
+	vector<string> binding_string_tokens(split_tokens.begin(), split_tokens.end());
 
 	// check for type 1 binding
 	size_t first_expl_pos = binding_string_tokens[0].find_first_of(EXPLICIT_STATE);
@@ -84,11 +95,11 @@ void getModuleBindings(Module& module, const string& binding_string, const strin
 	}
 
 	// bind all end states
-	for(auto& es : module.end_states()) {
+	for(uint32_t es : module.end_states()) {
 		// find explicit binding
 		size_t expl_index = 0;
 		for(; expl_index < expl_bindings.size(); ++expl_index) {
-			if(es == module.name() + BINDING_OPEN + expl_bindings[expl_index].first) {
+			if(module.state(es) == module.name() + BINDING_OPEN + expl_bindings[expl_index].first) {
 				break;
 			}
 		}
@@ -101,7 +112,7 @@ void getModuleBindings(Module& module, const string& binding_string, const strin
 	}
 }
 
-void insertModule(pair<Module, size_t>& module_pair, vector<Rule>& target, const string& entry, const vector<string>& exits) {
+void insertModule(pair<Module, size_t>& module_pair, vector<Rule>& target, const string& alphabet, const string& entry, const vector<string>& exits, bool slice) {
 	Module& module = module_pair.first;
 
 	if(module.end_states().size() != exits.size()) {
@@ -112,44 +123,46 @@ void insertModule(pair<Module, size_t>& module_pair, vector<Rule>& target, const
 	const string scope = string("_i") + to_string(module_pair.second) + BINDING_CLOSE;
 
 	// match end states to bindings
-	vector<pair<const string*, const string*>> bindings;
+	vector<pair<uint32_t, const string*>> bindings;
 	for(size_t i=0; i<module.end_states().size(); ++i) {
-		bindings.emplace_back();
-		bindings[bindings.size()-1].first = &module.end_states()[i];
-		bindings[bindings.size()-1].second = &exits[i];
+		bindings.emplace_back(module.end_states()[i], &exits[i]);
 	}
+	auto scoped = [&](uint32_t state) -> string {
+		return string(module.state(state)).append(scope);
+	};
+
+	// without slicing, enter at the start state and copy the whole module
+	vector<bool> used(module.rules().size(), !slice);
+	if(!slice) addRules(target, alphabet, entry, scoped(module.start_state()), NOP);
+
+	// insert module entry points. they skip the module's leading NOP rules, so only the reachable part of the module is needed
+	for(const auto& ep : module.entry_points()) {
+		if(!slice || alphabet.find(ep.symbol) == string::npos) continue;
+
+		if(ep.exits) { // the module is left right away, jump straight to the binding
+			const string& exit = *find_if(bindings.begin(), bindings.end(), [&](const pair<uint32_t, const string*>& b) {
+				return b.first == ep.state;
+			})->second;
+			target.emplace_back(entry, ep.symbol, exit, ep.new_symbol, NOP);
+			continue;
+		}
 
-	// insert module entry point
-	const string entry_state = string(module.start_state()).append(scope);
-	target.emplace_back(entry, ZERO_CHAR, entry_state, ZERO_CHAR, NOP);
-	target.emplace_back(entry, ONE_CHAR, entry_state, ONE_CHAR, NOP);
-
+		target.emplace_back(entry, ep.symbol, scoped(ep.state), ep.new_symbol, NOP);
+		for(size_t i : ep.rules) used[i] = true;
+	}
 
 	// insert rules of module. rules are copied for scoping modifications
-	for(const auto& r : module.rules()) {
-		const string* new_state_prefix = nullptr;
-		const string* new_state_suffix = nullptr;
+	for(size_t i=0; i<module.rules().size(); ++i) {
+		if(!used[i]) continue;
+		const ModuleRule& r = module.rules()[i];
 
 		// is the new state an end state? if so, bind it
-		bool is_end_state = false; // for some reason, find_if returns a nonzero but invalid pointer if the predicate never succeeded. this thing keeps track of that.
-		new_state_prefix = find_if(bindings.begin(), bindings.end(), [&](const pair<const string*, const string*>& b) {
-			if(*b.first == r.new_state) {
-				is_end_state = true;
-				return true;
-			}
-			return false;
-		})->second;
+		auto binding = find_if(bindings.begin(), bindings.end(), [&](const pair<uint32_t, const string*>& b) {
+			return b.first == r.new_state;
+		});
 
-		// this is no end state, scope normally (module-internally)
-		if(!is_end_state) {
-			new_state_prefix = &r.new_state;
-			new_state_suffix = &scope;
-		}
-
-		// create invocation scope for old state and import already scoped new state
-		target.emplace_back(r.old_state + scope, r.old_char,
-							*new_state_prefix + (new_state_suffix ? *new_state_suffix : ""),
-							r.new_char, r.dir);
+		// create invocation scope for old state, an end state is replaced by its binding, others are scoped normally (module-internally)
+		target.emplace_back(scoped(r.old_state), r.old_char, binding == bindings.end() ? scoped(r.new_state) : *binding->second, r.new_char, r.dir);
 	}
 
 	// update invocation count
@@ -176,17 +189,30 @@ auto NOPtimizeRule(const vector<Rule>& rules, Rule& rule, vector<string>& end_st
 			}
 		}
 		if(!found) {
+			// a state that misses only this symbol (e.g. a module with a smaller alphabet) faults at runtime anyway
+			if(any_of(rules.begin(), rules.end(), [&](const Rule& tr) {
+				return tr.old_state == rule.new_state;
+			})) return false;
 			throw runtime_error("Compiler: While NOPtimizing: state not found: " + rule.new_state);
 		}
 	}
 	return true;
 }
 
-void getReachableStates(vector<Rule>& rules, const string& start_state, const vector<string>& end_states, vector<string>& result) {
+auto countStates(const vector<Rule>& rules) -> size_t {
+	unordered_set<string> states;
+	for(auto& r : rules) {
+		states.insert(r.old_state);
+		states.insert(r.new_state);
+	}
+	return states.size();
+}
+
+void getReachableStates(vector<Rule>& rules, const string& start_state, const vector<string>& end_states, vector<string>& result, bool noptimized) {
 	// find all rules that start with start_state
 	for(auto& rule : rules) {
 		if(rule.old_state == start_state) {
-			bool stop = rule.dir == NOP; // after NOPtimizing, all rules except ending ones move
+			bool stop = noptimized && rule.dir == NOP; // after NOPtimizing, all rules except ending ones move
 			if(stop) continue; // ending rules don't reach any states
 
 			// is the new state already reachable?
@@ -197,23 +223,40 @@ void getReachableStates(vector<Rule>& rules, const string& start_state, const ve
 
 			// this rule reaches a new state, save it and recurse for it
 			result.push_back(rule.new_state);
-			getReachableStates(rules, rule.new_state, end_states, result);
+			getReachableStates(rules, rule.new_state, end_states, result, noptimized);
 		}
 	}
 }
 
-void Compiler::compile(const string& filename, vector<string>& result, const string& mod_path, uint verbosity) {
+void Compiler::compile(const string& filename, vector<string>& result, const string& mod_path, uint verbosity, Profiler* profiler, uint optimizations) {
 	result.clear();
 
+	// instrumentation, does nothing without a profiler
+	auto beginPass = [&](const string& name, const string& category) {
+		if(profiler != nullptr) profiler->begin(name, category);
+	};
+	// counting states is linear, passes that run once per module call skip it to stay out of the parse timing
+	auto endPass = [&](const vector<Rule>& pass_rules, bool with_states = true) {
+		if(profiler == nullptr) return;
+		profiler->end();
+		profiler->count(pass_rules.size(), with_states ? countStates(pass_rules) : NOT_COUNTED);
+	};
+
+	beginPass("compile " + filename, "compile");
+
 	// read file
-	vector<string> lines;
-	if(!Utils::readFile(filename, lines)) {
+	beginPass("read", "pass");
+	string buffer;
+	vector<string_view> lines;
+	if(!Utils::readFile(filename, buffer, lines)) {
 		throw runtime_error("Compiler: During startup: File " + filename + " not found!");
 	}
+	if(profiler != nullptr) profiler->end();
 
 	// the Module list. int is the invocation count for each module
 	vector<pair<Module, size_t>> module_list;
 
+	string alphabet = DEFAULT_ALPHABET;
 	string start_state {};
 	string current_state {};
 	size_t next_implicit_state = 0;
@@ -224,55 +267,96 @@ void Compiler::compile(const string& filename, vector<string>& result, const str
 	// compile program
 	if(verbosity > 0) cout << "Beginning compilation of file " << INFO_TEXT << filename << DEFAULT_TEXT << " ...\n";
 	auto start_time = chrono::high_resolution_clock::now();
+	// actions come first, every rule is emitted for the complete alphabet wherever the actions are in the file
+	beginPass("parse", "pass");
+	vector<string> branches;
 	for(auto& line : lines) {
-		if(line.empty()) continue;
-		if(line[0] == COMMENT_CHAR) continue;
-
-		// parse action
-		if(line[0] == ACTION_CHAR) {
-			// parse module
-			size_t pos = line.find_first_of(MODULE_STRING);
-			if(pos < string::npos) {
-				string module_name = line.substr(pos + MODULE_STRING.size() + 1, line.size() - (pos + MODULE_STRING.size() + 1));
-
-				// is module already loaded?
-				for(auto& m : module_list) {
-					if(m.first.name() == module_name) {
-						throw runtime_error("Compiler: Module " + module_name + " already loaded!");
-					}
-				}
-				if(verbosity > 0) cout << "Loading module " << INFO_TEXT << module_name << DEFAULT_TEXT << " ... ";
+		if(line.empty() || line[0] != ACTION_CHAR) continue;
 
-				// store new module
-				module_list.emplace_back(Module(module_name, mod_path), 0);
-				Module& m = module_list[module_list.size()-1].first;
+		size_t arg_pos = line.find_first_of(' ');
+		string_view action = line.substr(1, arg_pos == string::npos ? string_view::npos : arg_pos - 1);
+		if(action != ALPHABET_STRING && action != BRANCH_STRING && action != MODULE_STRING) {
+			// unknown actions are skipped, as they always were
+			if(verbosity > 0) cout << FAULT_TEXT << "Ignoring unknown action " << INFO_TEXT << line << DEFAULT_TEXT << '\n';
+			continue;
+		}
+		if(arg_pos == string::npos) {
+			throw runtime_error("Compiler: Missing argument of action " + string(line));
+		}
+		string argument(line.substr(arg_pos + 1));
 
-				// define scope
-				const string scope = module_name + BINDING_OPEN;
+		// declare additional tape symbols
+		if(action == ALPHABET_STRING) {
+			Module::extendAlphabet(alphabet, argument);
+		}
 
-				// apply scope to start state
-				m.start_state() = scope + m.start_state();
+		// branches are created once all symbols are known
+		else if(action == BRANCH_STRING) {
+			branches.push_back(argument);
+		}
 
-				// apply scope to end states
-				for(auto& es : m.end_states()) {
-					es.insert(es.begin(), scope.begin(), scope.end());
-					//es = scope + es;
-				}
+		// parse module
+		else {
+			string module_name = argument;
 
-				// apply scope to rules
-				for(auto& rule : module_list[module_list.size()-1].first.rules()) {
-					rule.old_state = scope + rule.old_state;
-					rule.new_state = scope + rule.new_state;
+			// is module already loaded?
+			for(auto& m : module_list) {
+				if(m.first.name() == module_name) {
+					throw runtime_error("Compiler: Module " + module_name + " already loaded!");
+				}
+			}
+			if(verbosity > 0) cout << "Loading module " << INFO_TEXT << module_name << DEFAULT_TEXT << " ... ";
+
+			// store new module, its symbols become part of the program's alphabet
+			beginPass("module " + module_name, "module");
+			module_list.emplace_back(Module(module_name, mod_path), 0);
+			Module& m = module_list[module_list.size()-1].first;
+			Module::extendAlphabet(alphabet, m.alphabet());
+
+			// apply scope to all states
+			m.scope(module_name + BINDING_OPEN);
+
+			// find the reachable part of the module for each entry symbol
+			m.analyze();
+			if(profiler != nullptr) {
+				profiler->end();
+				profiler->count(m.rules().size(), m.state_count());
+			}
+			if(verbosity > 0) cout << "Done.\n";
+			for(size_t i=0; i<m.end_states().size(); ++i) {
+				if(verbosity > 0 && !m.reachable_end_states()[i]) {
+					cout << FAULT_TEXT << "End state " << INFO_TEXT << m.state(m.end_states()[i]) << FAULT_TEXT << " can't be reached!\n" << DEFAULT_TEXT;
 				}
-				if(verbosity > 0) cout << "Done.\n";
 			}
 		}
+	}
+
+	// create a branching module over the alphabet
+	for(auto& name : branches) {
+		for(auto& m : module_list) {
+			if(m.first.name() == name) {
+				throw runtime_error("Compiler: Module " + name + " already loaded!");
+			}
+		}
+		module_list.emplace_back(Module::branch(name, alphabet), 0);
+		Module& m = module_list[module_list.size()-1].first;
+
+		// apply scope like for loaded modules
+		m.scope(name + BINDING_OPEN);
+		m.analyze();
+	}
+
+	for(auto& line : lines) {
+		if(line.empty()) continue;
+		if(line[0] == COMMENT_CHAR || line[0] == ACTION_CHAR) continue;
 
 		// try to load line as state header
-		else if(end_states.empty()) {
-			Utils::split(line, " ", end_states);
+		if(end_states.empty()) {
+			vector<string_view> tokens;
+			Utils::split(line, ' ', tokens);
+			end_states.assign(tokens.begin(), tokens.end());
 			if(end_states.size() < 2) {
-				throw runtime_error("Compiler: During startup: Parsing of " + line + " as state header failed: too few tokens!");
+				throw runtime_error("Compiler: During startup: Parsing of " + string(line) + " as state header failed: too few tokens!");
 			}
 			current_state = end_states[0];
 			start_state = current_state; // save start state for later
@@ -286,57 +370,66 @@ void Compiler::compile(const string& filename, vector<string>& result, const str
 				cout << DEFAULT_TEXT << '\n';
 			}
 
-			result.push_back(line);
+			result.emplace_back(line);
 		}
 
 		// load line as program data, read single characters
 		else {
 			size_t pos = 0;
-			string symbol {};
+			string_view symbol {}; // points into the line, grows while identifier characters are read
 			while(pos < line.size()) {
 				if(line[pos] == COMMENT_CHAR) {
 					pos = line.size(); // skip rest of line
+					continue;
 				}
 
 				if(line[pos] == LEFT_CHAR) {
-					rules.emplace_back(current_state, ZERO_CHAR, to_string(next_implicit_state), ZERO_CHAR, LEFT);
-					rules.emplace_back(current_state, ONE_CHAR, to_string(next_implicit_state), ONE_CHAR, LEFT);
+					addRules(rules, alphabet, current_state, to_string(next_implicit_state), LEFT);
 
 					current_state = to_string(next_implicit_state);
 					++next_implicit_state;
 					++pos;
 				}
 				else if(line[pos] == RIGHT_CHAR) {
-					rules.emplace_back(current_state, ZERO_CHAR, to_string(next_implicit_state), ZERO_CHAR, RIGHT);
-					rules.emplace_back(current_state, ONE_CHAR, to_string(next_implicit_state), ONE_CHAR, RIGHT);
+					addRules(rules, alphabet, current_state, to_string(next_implicit_state), RIGHT);
 
 					current_state = to_string(next_implicit_state);
 					++next_implicit_state;
 					++pos;
 				}
 				else if(symbol.empty() && line[pos] == ZERO_CHAR) {
-					rules.emplace_back(current_state, ZERO_CHAR, to_string(next_implicit_state), ZERO_CHAR, NOP);
-					rules.emplace_back(current_state, ONE_CHAR, to_string(next_implicit_state), ZERO_CHAR, NOP);
+					addRules(rules, alphabet, current_state, to_string(next_implicit_state), NOP, ZERO_CHAR);
 
 					current_state = to_string(next_implicit_state);
 					++next_implicit_state;
 					++pos;
 				}
 				else if(symbol.empty() && line[pos] == ONE_CHAR) {
-					rules.emplace_back(current_state, ZERO_CHAR, to_string(next_implicit_state), ONE_CHAR, NOP);
-					rules.emplace_back(current_state, ONE_CHAR, to_string(next_implicit_state), ONE_CHAR, NOP);
+					addRules(rules, alphabet, current_state, to_string(next_implicit_state), NOP, ONE_CHAR);
 
 					current_state = to_string(next_implicit_state);
 					++next_implicit_state;
 					++pos;
 				}
+				else if(symbol.empty() && line[pos] == WRITE_CHAR) { // write any symbol of the alphabet
+					if(pos + 1 >= line.size() || alphabet.find(line[pos+1]) == string::npos) {
+						throw runtime_error("Compiler: Missing or undeclared symbol after " + string(1, WRITE_CHAR) + " on line " + string(line));
+					}
+					addRules(rules, alphabet, current_state, to_string(next_implicit_state), NOP, line[pos+1]);
+
+					current_state = to_string(next_implicit_state);
+					++next_implicit_state;
+					pos += 2;
+				}
 				else if(isWhitespace(line[pos])) {
 					if(symbol.empty()) ++pos;
 					else { // this is an in-place module call, route all outputs to next implicit state
 						vector<string> bindings;
 						size_t index = getModuleIndex(module_list, symbol);
 						getModuleBindings(module_list[index].first, "", to_string(next_implicit_state), bindings);
-						insertModule(module_list[index], rules, current_state, bindings);
+						beginPass(string("insert ").append(symbol), "insert");
+						insertModule(module_list[index], rules, alphabet, current_state, bindings, optimizations & OPT_SLICE);
+						endPass(rules, false);
 
 						current_state = to_string(next_implicit_state);
 						++next_implicit_state;
@@ -346,22 +439,24 @@ void Compiler::compile(const string& filename, vector<string>& result, const str
 				}
 				else if(line[pos] == BINDING_OPEN) { // this is a bound module call
 					if(symbol.empty()) {
-						throw runtime_error("Compiler: missing module name on line " + line);
+						throw runtime_error("Compiler: missing module name on line " + string(line));
 					}
 
 					size_t closing = line.find(BINDING_CLOSE, pos);
 					if(closing == string::npos) {
-						throw runtime_error("Compiler: Unterminated " + string(1, BINDING_OPEN) + " on line " + line);
+						throw runtime_error("Compiler: Unterminated " + string(1, BINDING_OPEN) + " on line " + string(line));
 					}
 					// locate bindings
-					string binding_string = line.substr(pos + 1, closing - (pos + 1));
+					string binding_string(line.substr(pos + 1, closing - (pos + 1)));
 					pos = closing + 1; // consume enclosed binding string
 					vector<string> bindings;
 
 					// insert bound module
 					size_t index = getModuleIndex(module_list, symbol);
 					getModuleBindings(module_list[index].first, binding_string, to_string(next_implicit_state), bindings);
-					insertModule(module_list[index], rules, current_state, bindings);
+					beginPass(string("insert ").append(symbol), "insert");
+					insertModule(module_list[index], rules, alphabet, current_state, bindings, optimizations & OPT_SLICE);
+					endPass(rules, false);
 
 					current_state = to_string(next_implicit_state);
 					++next_implicit_state;
@@ -369,8 +464,7 @@ void Compiler::compile(const string& filename, vector<string>& result, const str
 				}
 				else if(!symbol.empty() && line[pos] == EXPLICIT_STATE) {
 					// bind current state to symbol
-					rules.emplace_back(current_state, ZERO_CHAR, symbol, ZERO_CHAR, NOP);
-					rules.emplace_back(current_state, ONE_CHAR, symbol, ONE_CHAR, NOP);
+					addRules(rules, alphabet, current_state, string(symbol), NOP);
 
 					// change current state to symbol
 					current_state = symbol;
@@ -382,18 +476,18 @@ void Compiler::compile(const string& filename, vector<string>& result, const str
 						(symbol.empty() && line[pos] != ZERO_CHAR && line[pos] != ONE_CHAR) || // read all numbers except 1 and 0
 						(!symbol.empty() && (isText(line[pos]) || isNumber(line[pos]))) // tmp is already filled, read every number and characte
 						) {
-					symbol.push_back(line[pos]);
+					symbol = line.substr(pos - symbol.size(), symbol.size() + 1);
 					++pos;
 				} else {
-					throw runtime_error("Compiler: Invalid character " + string(1, line[pos]) + " on line " + line + " !");
+					throw runtime_error("Compiler: Invalid character " + string(1, line[pos]) + " on line " + string(line) + " !");
 				}
 			}
 		}
 	}
 
 	// bind current state to first end binding
-	rules.emplace_back(current_state, ZERO_CHAR, end_states[0], ZERO_CHAR, NOP);
-	rules.emplace_back(current_state, ONE_CHAR, end_states[0], ONE_CHAR, NOP);
+	addRules(rules, alphabet, current_state, end_states[0], NOP);
+	endPass(rules);
 
 
 	if(verbosity > 0) {
@@ -406,18 +500,29 @@ void Compiler::compile(const string& filename, vector<string>& result, const str
 		cout << "NOPtimizer started... ";
 	}
 
-	for(auto& rule : rules) { // find next NOP rule
+	beginPass("noptimize", "pass");
+	vector<bool> dead_rules(rules.size(), false);
+	for(size_t i=0; i<rules.size() && (optimizations & OPT_NOP); ++i) { // find next NOP rule
+		Rule& rule = rules[i];
 		if(rule.dir == NOP) {
 			for(auto& es : end_states) {
 				if(rule.new_state == es) goto optimize_next_rule; // can't optimize ending rule
 			}
 
-			if(!NOPtimizeRule(rules, rule, end_states)) continue; // rule can't be optimized further
+			if(!NOPtimizeRule(rules, rule, end_states)) dead_rules[i] = true; // rule leads into a missing transition
 optimize_next_rule:
 			continue;
 		}
 	}
 
+	// drop rules that lead into missing transitions, this keeps the "all NOP rules are ending" invariant
+	size_t kept = 0;
+	for(size_t i=0; i<rules.size(); ++i) {
+		if(!dead_rules[i]) rules[kept++] = rules[i];
+	}
+	rules.resize(kept);
+	endPass(rules);
+
 	if(verbosity > 0) {
 		cout << "Done!\n";
 		if(verbosity >= 2) {
@@ -428,9 +533,14 @@ optimize_next_rule:
 		cout << "Searching for reachable states... ";
 	}
 
+	beginPass("reachable", "pass");
 	vector<string> reachable_states {};
-	getReachableStates(rules, start_state, end_states, reachable_states);
+	getReachableStates(rules, start_state, end_states, reachable_states, optimizations & OPT_NOP);
 	reachable_states.push_back(start_state); // we also reach the start state implicitly
+	if(profiler != nullptr) {
+		profiler->end();
+		profiler->count(rules.size(), reachable_states.size());
+	}
 
 	if(verbosity > 0) {
 		cout << "Done with " << INFO_TEXT << reachable_states.size() << DEFAULT_TEXT << " reachable states!\n";
@@ -444,7 +554,8 @@ optimize_next_rule:
 		cout << "Removing unreachable rules... ";
 	}
 
-	bool changed = true;
+	beginPass("erase", "pass");
+	bool changed = optimizations & OPT_ERASE;
 	while(changed) {
 		changed = false;
 
@@ -462,6 +573,8 @@ optimize_next_rule:
 		}
 	}
 
+	endPass(rules);
+
 	auto elapsed_time = chrono::high_resolution_clock::now() - start_time;
 	if(verbosity > 0) {
 		cout << "Done, finished with " << INFO_TEXT << rules.size() << DEFAULT_TEXT << " rules!\n";
@@ -475,6 +588,12 @@ optimize_next_rule:
 		}
 	}
 
+	// the rule parser needs to know about additional symbols before the first rule
+	beginPass("emit", "pass");
+	if(alphabet != DEFAULT_ALPHABET) {
+		result.insert(result.begin(), string(1, ACTION_CHAR) + ALPHABET_STRING + ' ' + alphabet.substr(DEFAULT_ALPHABET.size()));
+	}
+
 	for(auto& r : rules) {
 		string move_string = "ERROR_INVALID_MOVE";
 		if(r.dir == LEFT) move_string = "<";
@@ -482,4 +601,101 @@ optimize_next_rule:
 		else if(r.dir == NOP) move_string = "-";
 		result.push_back(r.old_state + " " + string(1, r.old_char) + " " + r.new_state + " " + string(1, r.new_char) + " " + move_string);
 	}
+	endPass(rules);
+	endPass(rules); // whole compilation
+}
+
+auto cppLiteral(const string& text, char quote) -> string {
+	string literal(1, quote);
+	for(char c : text) {
+		if(c == quote || c == '\\') literal.push_back('\\');
+		literal.push_back(c);
+	}
+	return literal + quote;
+}
+
+void Compiler::emitHeader(const Table& table, const string& name, vector<string>& result) {
+	result.clear();
+
+	// keywords and names the header itself uses can't be the type name
+	static const unordered_set<string> taken_names = {
+		"alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand", "bitor", "bool", "break",
+		"case", "catch", "char", "char8_t", "char16_t", "char32_t", "class", "co_await", "co_return",
+		"co_yield", "compl", "concept", "const", "const_cast", "consteval", "constexpr", "constinit",
+		"continue", "decltype", "default", "delete", "do", "double", "dynamic_cast", "else", "enum",
+		"explicit", "export", "extern", "false", "final", "float", "for", "friend", "goto", "if",
+		"import", "inline", "int", "long", "module", "mutable", "namespace", "new", "noexcept", "not",
+		"not_eq", "nullptr", "operator", "or", "or_eq", "override", "private", "protected", "public",
+		"register", "reinterpret_cast", "requires", "return", "short", "signed", "sizeof", "static",
+		"static_assert", "static_cast", "struct", "switch", "template", "this", "thread_local",
+		"throw", "true", "try", "typedef", "typeid", "typename", "union", "unsigned", "using",
+		"virtual", "void", "volatile", "wchar_t", "while", "xor", "xor_eq",
+		"std", "StaticStateType", "StaticTransition", "StaticExecutor",
+	};
+
+	// the machine name is used as type name, strip any path and replace invalid characters
+	string type_name;
+	for(char c : name.substr(name.find_last_of('/') + 1)) {
+		if(!isText(c) && !isNumber(c)) c = '_';
+		// double underscores are reserved
+		if(c == '_' && !type_name.empty() && type_name.back() == '_') continue;
+		type_name.push_back(c);
+	}
+	// so is a leading underscore, prefix it together with names that aren't usable otherwise
+	if(type_name.empty() || isNumber(type_name[0]) || taken_names.count(type_name) > 0) {
+		type_name.insert(0, "Machine_");
+	} else if(type_name[0] == '_') {
+		type_name.insert(0, "Machine");
+	}
+
+	string guard = "AQUA_MACHINE_" + type_name;
+	if(guard.back() != '_') guard.push_back('_');
+	guard.push_back('H');
+	transform(guard.begin(), guard.end(), guard.begin(), [](char c) {return static_cast<char>(toupper(c));});
+
+	const size_t state_count = table.state_count();
+	const size_t symbol_count = table.symbol_count();
+
+	result.push_back("// Generated by AQUA from " + name + AQUA_COMPILED_EXT + ", do not edit.");
+	result.push_back("#ifndef " + guard);
+	result.push_back("#define " + guard);
+	result.emplace_back();
+	result.push_back("#include \"staticexecutor.h\"");
+	result.emplace_back();
+	result.push_back("struct " + type_name + " {");
+	result.push_back("\tusing State = StaticStateType<" + to_string(state_count) + ">;");
+	result.push_back("\tstatic constexpr State state_count = " + to_string(state_count) + ";");
+	result.push_back("\tstatic constexpr char alphabet[] = " + cppLiteral(table.alphabet(), '"') + ";");
+	result.push_back("\tstatic constexpr State start_state = " + to_string(table.start_state()) + ";");
+
+	string end_states = "\tstatic constexpr State end_states[] = {";
+	for(uint32_t s=0; s<state_count; ++s) {
+		if(table.isEndState(s)) end_states += to_string(s) + ", ";
+	}
+	end_states.erase(end_states.size() - 2);
+	result.push_back(end_states + "};");
+
+	result.push_back("\tstatic constexpr const char* state_names[] = {");
+	for(auto& sn : table.state_names()) {
+		result.push_back("\t\t" + cppLiteral(sn, '"') + ",");
+	}
+	result.push_back("\t};");
+
+	result.push_back("\tstatic constexpr StaticTransition<State> transitions[] = {");
+	for(uint32_t s=0; s<state_count; ++s) {
+		string line = "\t\t";
+		for(size_t c=0; c<symbol_count; ++c) {
+			const Transition& t = table.at(s, static_cast<uint8_t>(c));
+			int move = t.dir == LEFT ? -1 : (t.dir == RIGHT ? 1 : 0);
+			line += "{" + to_string(t.new_state == NO_STATE ? state_count : t.new_state) + ", "
+					+ cppLiteral(string(1, table.symbol(t.new_symbol)), '\'') + ", "
+					+ to_string(move) + "}, ";
+		}
+		line.pop_back();
+		result.push_back(line + " // " + table.state_names()[s]);
+	}
+	result.push_back("\t};");
+	result.push_back("};");
+	result.emplace_back();
+	result.push_back("#endif // " + guard);
 }
@@ -4,13 +4,27 @@
 #include <string>
 #include <vector>
 
+class Table;
+class Profiler;
+
+// optimization passes of the compiler, the output of all combinations behaves the same
+enum Optimization : uint {
+	OPT_NONE = 0,
+	OPT_SLICE = 1, // insert only the part of a module that is reachable from its entry symbol
+	OPT_NOP = 2, // merge NOP rules into the rules that lead to them
+	OPT_ERASE = 4, // remove rules of unreachable states
+	OPT_ALL = OPT_SLICE | OPT_NOP | OPT_ERASE
+};
+
 class Compiler {
 public:
 	static auto isWhitespace(char c) -> bool;
 	static auto isText(char c) -> bool;
 	static auto isNumber(char c) -> bool;
 
-	static void compile(const std::string& filename, std::vector<std::string>& result, const std::string& mod_path = "", uint verbosity = 0);
+	static void compile(const std::string& filename, std::vector<std::string>& result, const std::string& mod_path = "", uint verbosity = 0,
+						Profiler* profiler = nullptr, uint optimizations = OPT_ALL);
+	static void emitHeader(const Table& table, const std::string& name, std::vector<std::string>& result);
 };
 
 #endif // COMPILER_H
@@ -11,18 +11,39 @@ using namespace std;
  * old_state old_char new_state new_char {< > -}
  */
 
-Executor::Executor(Module& module) : m_state(module.start_state()), m_module(module) {}
+Executor::Executor(Module& module) : Executor(prepare(module)) {}
+
+Executor::Executor(shared_ptr<const Table> table) : m_table(move(table)), m_state(m_table->start_state()) {}
+
+auto Executor::prepare(Module& module) -> shared_ptr<const Table> {
+	auto table = make_shared<Table>(module);
+	table->fuse();
+	return table;
+}
 
 void Executor::setMem(const std::string& mem) {
 	m_mem = mem;
+	m_valid_symbols = all_of(m_mem.begin(), m_mem.end(), [&](char c) {
+		return m_table->code(c) >= 0;
+	});
+	m_valid_mem = m_valid_symbols && m_head_pos < m_mem.size();
 }
 
 void Executor::setHeadPos(size_t head_pos) {
 	m_head_pos = head_pos;
+	m_valid_mem = m_valid_symbols && m_head_pos < m_mem.size();
+}
+
+void Executor::setState(const std::string& state) {
+	auto it = find(m_table->state_names().begin(), m_table->state_names().end(), state);
+	if(it == m_table->state_names().end()) {
+		throw runtime_error("Executor: Unknown state " + state);
+	}
+	m_state = static_cast<uint32_t>(it - m_table->state_names().begin());
 }
 
 void Executor::print() const {
-	cout << "In state: " << INFO_TEXT << m_state << DEFAULT_TEXT << '\n';
+	cout << "In state: " << INFO_TEXT << m_table->state_names()[m_state] << DEFAULT_TEXT << '\n';
 	cout << m_mem << '\n';
 
 	for(size_t i=0; i<m_head_pos; ++i) {
@@ -31,40 +52,105 @@ void Executor::print() const {
 	cout << "↑\n";
 }
 
+auto Executor::transition() const -> const Transition& {
+	const char cell = m_mem[m_head_pos];
+	int code = m_table->code(cell);
+	if(code < 0 || m_table->at(m_state, static_cast<uint8_t>(code)).new_state == NO_STATE) {
+		throw runtime_error("Executor: No rule found for state " + m_table->state_names()[m_state] + " and char " + cell);
+	}
+	return m_table->at(m_state, static_cast<uint8_t>(code));
+}
+
+void Executor::apply(const Transition& t) {
+	m_state = t.new_state;
+	m_mem[m_head_pos] = m_table->symbol(t.new_symbol);
+
+	if(t.dir == LEFT) {
+		if(m_head_pos == 0) {
+			m_mem.insert(m_mem.begin(), ZERO_CHAR);
+		} else {
+			--m_head_pos;
+		}
+	}
+	else if(t.dir == RIGHT) {
+		++m_head_pos;
+		if(m_head_pos == m_mem.size()) {
+			m_mem.push_back(ZERO_CHAR);
+		}
+	}
+}
+
+void Executor::apply(const FusedTransition& f) {
+	// grow the memory over every cell the chain visits, exactly like single steps would
+	long head = static_cast<long>(m_head_pos);
+	if(head + f.min_offset < 0) {
+		size_t grow = static_cast<size_t>(-(head + f.min_offset));
+		m_mem.insert(m_mem.begin(), grow, ZERO_CHAR);
+		head += static_cast<long>(grow);
+	}
+	if(head + f.max_offset >= static_cast<long>(m_mem.size())) {
+		m_mem.resize(static_cast<size_t>(head + f.max_offset + 1), ZERO_CHAR);
+	}
+
+	for(size_t i=f.writes_begin; i<f.writes_end; ++i) {
+		const FusedWrite& w = m_table->fused_writes()[i];
+		m_mem[static_cast<size_t>(head + w.offset)] = m_table->symbol(w.new_symbol);
+	}
+
+	m_head_pos = static_cast<size_t>(head + f.shift);
+	m_state = f.new_state;
+}
+
 auto Executor::step() -> bool {
+	if(m_head_pos >= m_mem.size()) {
+		throw runtime_error("Executor: Head position outside of memory");
+	}
+
 	// find rule
-	for(auto& r : m_module.rules()) {
-		if(r.old_state == m_state && r.old_char == m_mem[m_head_pos]) {
-			m_state = r.new_state;
-			m_mem[m_head_pos] = r.new_char;
-
-			cout << INFO_TEXT << r.old_state <<  ' ' << r.old_char << DEFAULT_TEXT << " → " << INFO_TEXT << r.new_state << ' ' << r.new_char << ' ';
-
-			if(r.dir == LEFT) {
-				if(m_head_pos == 0) {
-					m_mem.insert(m_mem.begin(), ZERO_CHAR);
-				} else {
-					--m_head_pos;
-				}
-
-				cout << '<';
-			}
-			else if(r.dir == RIGHT) {
-				++m_head_pos;
-				if(m_head_pos == m_mem.size()) {
-					m_mem.push_back(ZERO_CHAR);
-				}
-
-				cout  << '>';
-			} else cout << '-';
-			cout << DEFAULT_TEXT;
-
-			// if we are in an end state, return false to indicate that we are done
-			return !any_of(m_module.end_states().begin(), m_module.end_states().end(), [&](const string& s) {
-				return s == m_state;
-			});
+	const Transition& t = transition();
+
+	cout << INFO_TEXT << m_table->state_names()[m_state] <<  ' ' << m_mem[m_head_pos] << DEFAULT_TEXT << " → ";
+	apply(t);
+	cout << INFO_TEXT << m_table->state_names()[m_state] << ' ' << m_table->symbol(t.new_symbol) << ' ';
+
+	if(t.dir == LEFT) cout << '<';
+	else if(t.dir == RIGHT) cout << '>';
+	else cout << '-';
+	cout << DEFAULT_TEXT;
+
+	// if we are in an end state, return false to indicate that we are done
+	return !m_table->isEndState(m_state);
+}
+
+auto Executor::run(size_t max_steps) -> size_t {
+	// moving never leaves the memory, so the head only has to be checked once
+	if(m_head_pos >= m_mem.size()) {
+		throw runtime_error("Executor: Head position outside of memory");
+	}
+
+	size_t steps = 0;
+	// without chains, or with cells a chain could write over unchecked, every step is looked up
+	if(!m_table->hasFused() || !m_valid_mem) {
+		while(steps < max_steps) {
+			apply(transition());
+			++steps;
+			if(m_table->isEndState(m_state)) break;
 		}
+		return steps;
 	}
 
-	throw runtime_error("Executor: No rule found for state " + m_state + " and char " + m_mem[m_head_pos]);
+	while(steps < max_steps) {
+		// fused chains only read symbols that they wrote themselves or that are already valid
+		const FusedTransition* f = &m_table->fused(m_state);
+		if(f->new_state != NO_STATE && f->steps <= max_steps - steps) {
+			apply(*f);
+			steps += f->steps;
+		} else {
+			apply(transition());
+			++steps;
+		}
+
+		if(m_table->isEndState(m_state)) break;
+	}
+	return steps;
 }
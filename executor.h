@@ -1,23 +1,47 @@
 #ifndef EXECUTOR_H
 #define EXECUTOR_H
 
+#include <memory>
 #include <string>
 #include "module.h"
+#include "table.h"
 
 class Executor {
-	std::string m_state {};
+	std::shared_ptr<const Table> m_table; // shared between executors of the same machine
+	uint32_t m_state = 0;
 	std::string m_mem {};
 	size_t m_head_pos = 0;
-	Module m_module;
+	bool m_valid_symbols = false; // true if every cell holds a symbol of the alphabet
+	bool m_valid_mem = false; // true if the symbols are valid and the head is on one of them
+
+	auto transition() const -> const Transition&;
+	void apply(const Transition& t);
+	void apply(const FusedTransition& f);
 
 public:
 	explicit Executor(Module& m);
+	// the table should be fused already, else only single steps are taken
+	explicit Executor(std::shared_ptr<const Table> table);
+
+	// builds the table of a module and fuses it, ready to be shared by many executors
+	static auto prepare(Module& module) -> std::shared_ptr<const Table>;
 
 	void setMem(const std::string& mem);
 	void setHeadPos(size_t head_pos);
+	void setState(const std::string& state);
+
+	auto table() const -> const Table& {return *m_table;}
+	auto state() const -> const std::string& {return m_table->state_names()[m_state];}
+	auto mem() const -> const std::string& {return m_mem;}
+	auto headPos() const -> size_t {return m_head_pos;}
+	auto done() const -> bool {return m_table->isEndState(m_state);}
 
 	void print() const;
 	auto step() -> bool;
+
+	// runs silently until an end state is reached or max_steps are done, returns the number of steps taken.
+	// like step, it throws if the head is not on a cell of the memory
+	auto run(size_t max_steps = SIZE_MAX) -> size_t;
 };
 
 #endif // EXECUTOR_H
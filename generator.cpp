@@ -0,0 +1,146 @@
+#include "generator.h"
+#include "module.h"
+#include "globals.h"
+#include <algorithm>
+using namespace std;
+
+static const string EXTRA_SYMBOLS = "abc";
+
+Generator::Generator(uint64_t seed) : m_rng(seed) {}
+
+auto Generator::chance(double p) -> bool {
+	return uniform_real_distribution<double>(0, 1)(m_rng) < p;
+}
+
+auto Generator::pick(size_t n) -> size_t {
+	return uniform_int_distribution<size_t>(0, n - 1)(m_rng);
+}
+
+auto Generator::extraSymbols() -> string {
+	if(!chance(0.3)) return "";
+	return EXTRA_SYMBOLS.substr(0, 1 + pick(EXTRA_SYMBOLS.size()));
+}
+
+void Generator::table(vector<string>& result, size_t max_states) {
+	result.clear();
+	const string extra = extraSymbols();
+	const string alphabet = DEFAULT_ALPHABET + extra;
+	if(!extra.empty()) result.push_back(string(1, ACTION_CHAR) + ALPHABET_STRING + DELIM + extra);
+
+	const size_t state_count = 1 + pick(max_states);
+	const size_t end_count = 1 + pick(2);
+	auto stateName = [](size_t i) {return "s" + to_string(i);};
+	auto endName = [](size_t i) {return "e" + to_string(i);};
+
+	string header = stateName(0);
+	for(size_t i=0; i<end_count; ++i) header += DELIM + endName(i);
+	result.push_back(header);
+
+	vector<string> rules;
+	auto addRule = [&](const string& old_state, char old_char) {
+		string new_state = chance(0.15) ? endName(pick(end_count)) : stateName(pick(state_count));
+		char new_char = chance(0.8) ? alphabet[pick(2)] : alphabet[pick(alphabet.size())];
+		double move = uniform_real_distribution<double>(0, 1)(m_rng);
+		char dir = move < 0.4 ? LEFT_CHAR : (move < 0.8 ? RIGHT_CHAR : NOP_CHAR);
+		rules.push_back(old_state + DELIM + old_char + DELIM + new_state + DELIM + new_char + DELIM + dir);
+	};
+
+	for(size_t s=0; s<state_count; ++s) {
+		for(char c : alphabet) {
+			if(chance(0.1)) continue; // missing rule, faults when it is needed
+			addRule(stateName(s), c);
+			if(chance(0.05)) addRule(stateName(s), c); // duplicate, the first one wins
+		}
+	}
+	if(chance(0.1)) addRule(endName(0), alphabet[0]); // end states never execute their rules
+
+	// the order of the rules must not matter, except between duplicates
+	shuffle(rules.begin(), rules.end(), m_rng);
+	result.insert(result.end(), rules.begin(), rules.end());
+}
+
+void Generator::program(const vector<ModuleInfo>& modules, vector<string>& result, size_t max_lines) {
+	result.clear();
+	const string extra = extraSymbols();
+	const string alphabet = DEFAULT_ALPHABET + extra;
+	if(!extra.empty()) result.push_back(string(1, ACTION_CHAR) + ALPHABET_STRING + DELIM + extra);
+
+	// load some modules, maybe create a branch over the alphabet
+	vector<ModuleInfo> loaded;
+	for(auto& m : modules) {
+		if(chance(0.5)) loaded.push_back(m);
+	}
+	if(loaded.empty() && !modules.empty()) loaded.push_back(modules[pick(modules.size())]);
+	for(auto& m : loaded) {
+		result.push_back(string(1, ACTION_CHAR) + MODULE_STRING + DELIM + m.name);
+	}
+	if(chance(0.4)) {
+		ModuleInfo branch {"B", {}};
+		for(char c : alphabet) branch.end_states.emplace_back(1, c);
+		result.push_back(string(1, ACTION_CHAR) + BRANCH_STRING + DELIM + branch.name);
+		loaded.push_back(branch);
+	}
+
+	vector<string> end_states = {"end"};
+	if(chance(0.3)) end_states.emplace_back("alt");
+	string header = "start";
+	for(auto& es : end_states) header += DELIM + es;
+	result.emplace_back();
+	result.push_back(header);
+
+	// every line except the first gets a label, jumps can go to labels and end states
+	const size_t line_count = 1 + pick(max_lines);
+	vector<string> targets = end_states;
+	for(size_t i=1; i<line_count; ++i) targets.push_back("L" + to_string(i));
+	auto target = [&] {return targets[pick(targets.size())];};
+
+	for(size_t i=0; i<line_count; ++i) {
+		string line;
+		if(i > 0) {
+			// a labelled line moves first, so no chain of jumps can loop without moving
+			line += "L" + to_string(i) + EXPLICIT_STATE + DELIM + (chance(0.5) ? LEFT_CHAR : RIGHT_CHAR) + DELIM;
+		}
+
+		const size_t token_count = 1 + pick(7);
+		for(size_t t=0; t<token_count; ++t) {
+			double kind = uniform_real_distribution<double>(0, 1)(m_rng);
+			if(kind < 0.15) line += ZERO_CHAR;
+			else if(kind < 0.25) line += ONE_CHAR;
+			else if(kind < 0.4) line += LEFT_CHAR;
+			else if(kind < 0.55) line += RIGHT_CHAR;
+			else if(kind < 0.6) line += string(1, WRITE_CHAR) + alphabet[pick(alphabet.size())];
+			else if(!loaded.empty()) {
+				const ModuleInfo& m = loaded[pick(loaded.size())];
+				double binding = uniform_real_distribution<double>(0, 1)(m_rng);
+				if(binding < 0.3) { // in place
+					line += m.name;
+				} else if(binding < 0.4) { // type 0
+					line += m.name + BINDING_OPEN + BINDING_CLOSE;
+				} else if(binding < 0.55 && m.end_states.size() == 1) { // pure type 1
+					line += m.name + BINDING_OPEN + target() + BINDING_CLOSE;
+				} else if(binding < 0.7) { // special type 1
+					line += m.name + BINDING_OPEN + ACTION_CHAR + target() + BINDING_CLOSE;
+				} else { // type 2, end states without a binding go on with the next token
+					string bindings;
+					for(auto& es : m.end_states) {
+						if(!chance(0.7)) continue;
+						if(!bindings.empty()) bindings += DELIM;
+						bindings += es + EXPLICIT_STATE + target();
+					}
+					if(bindings.empty()) bindings = m.end_states[0] + EXPLICIT_STATE + target();
+					line += m.name + BINDING_OPEN + bindings + BINDING_CLOSE;
+				}
+			}
+			line += DELIM; // also ends in-place module calls
+		}
+		result.push_back(line);
+	}
+}
+
+void Generator::memory(const string& alphabet, size_t max_length, string& mem, size_t& head_pos) {
+	mem.resize(1 + pick(max_length));
+	for(auto& c : mem) {
+		c = chance(0.9) ? alphabet[pick(2)] : alphabet[pick(alphabet.size())];
+	}
+	head_pos = pick(mem.size());
+}
@@ -0,0 +1,39 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+// what a program needs to know about a module to call it with every kind of binding
+struct ModuleInfo {
+	std::string name;
+	std::vector<std::string> end_states; // without the module scope
+};
+
+/*
+ * Produces random but valid machines and programs. Tables can miss rules,
+ * contain duplicate rules and use additional symbols. Programs call modules
+ * in place and with type 0, type 1, special type 1 and type 2 bindings,
+ * jump between labels and use !alphabet, !branch and symbol writes.
+ */
+class Generator {
+	std::mt19937_64 m_rng;
+
+	auto chance(double p) -> bool;
+	auto pick(size_t n) -> size_t;
+	auto extraSymbols() -> std::string;
+
+public:
+	explicit Generator(uint64_t seed);
+
+	// a table in .aquacomp syntax
+	void table(std::vector<std::string>& result, size_t max_states = 10);
+	// a program in .aquasrc syntax that loads some of the given modules
+	void program(const std::vector<ModuleInfo>& modules, std::vector<std::string>& result, size_t max_lines = 5);
+	// a memory over the alphabet (mostly its first two symbols) and a head position inside it
+	void memory(const std::string& alphabet, size_t max_length, std::string& mem, size_t& head_pos);
+};
+
+#endif // GENERATOR_H
@@ -5,6 +5,7 @@
 
 static constexpr char ZERO_CHAR = '0';
 static constexpr char ONE_CHAR = '1';
+static const std::string DEFAULT_ALPHABET = {ZERO_CHAR, ONE_CHAR}; // ZERO_CHAR is also the blank symbol
 
 static constexpr char LEFT_CHAR = '<';
 static constexpr char RIGHT_CHAR = '>';
@@ -16,11 +17,21 @@ static constexpr char EXPLICIT_STATE = ':';
 
 static constexpr char COMMENT_CHAR = '#';
 static constexpr char ACTION_CHAR = '!';
+static constexpr char WRITE_CHAR = '=';
+
+// every byte can be a symbol except for the ones the rule and binding syntax reserves:
+// space and the control characters below it, DEL, BINDING_OPEN, BINDING_CLOSE, EXPLICIT_STATE and COMMENT_CHAR
+static constexpr size_t MAX_SYMBOLS = 256 - 33 - 1 - 4;
 
 static const std::string MODULE_STRING = "module";
+static const std::string ALPHABET_STRING = "alphabet";
+static const std::string BRANCH_STRING = "branch";
 
 static const std::string AQUA_SOURCE_EXT = ".aquasrc";
 static const std::string AQUA_COMPILED_EXT = ".aquacomp";
+static const std::string AQUA_HEADER_EXT = ".h";
+static const std::string AQUA_PROFILE_EXT = ".profile.json";
+static const std::string AQUA_TRACE_EXT = ".trace.json";
 
 static const std::string DEFAULT_TEXT = "\033[0m";
 static const std::string FAULT_TEXT = "\033[31;1m";
@@ -1,9 +1,19 @@
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <vector>
+#include <algorithm>
 
 #include "executor.h"
+#include "blockexecutor.h"
+#include "batchexecutor.h"
+#include "server.h"
+#include "client.h"
+#include "resultcache.h"
+#include "stress.h"
 #include "compiler.h"
+#include "table.h"
+#include "profiler.h"
 #include "utils.h"
 #include "globals.h"
 
@@ -17,31 +27,180 @@ auto main(int argc, char* argv[]) -> int {
 
 		cerr << "aquasrc: compile the file to an aquacomp file with the same name. Options:\n";
 		cout << "[path]: Search for modules in that path too.\n";
-		cout << "[q | v]: quiet or verbose\n";
+		cout << "[q | v][h][p][t]: quiet or verbose, h also writes the machine as constexpr C++ header\n";
+		cout << "p and t write per-pass timing, rule counts and memory as JSON or Chrome trace events\n";
+		cout << "[s][n][e]: turn off slicing of modules, the NOPtimizer or erasing of unreachable states\n";
 
 		cerr << "aquacomp: execute the program contained in the file. Options:\n";
-		cout << "[initial memory]: The string of 1 and 0 that should be loaded into the machine. Defaults to 0.\n";
+		cout << "[initial memory]: The string of symbols (1 and 0 unless the program declares more) that should be loaded into the machine. Defaults to 0.\n";
 		cout << "[head position]: The position of the machine's read/write head relative to the initial memory.\n";
+		cout << "[r | b[block size]]: run to the end without showing each step, then print the result and speed.\n";
+		cout << "[result cache]: with r, look up and store the result in this file instead of always executing.\n";
+		cout << "b uses memoized transitions of whole blocks of cells (default size " << DEFAULT_BLOCK_SIZE << ").\n";
+		cout << "m[lanes]: initial memory names a file with one memory (and optionally a head position) per line,\n";
+		cout << "all of them are run in lockstep (default " << DEFAULT_BATCH_LANES << " lanes) and one result per line is printed.\n";
+
+		cerr << "Instead of a filename:\n";
+		cout << "serve <socket> [workers] [machine cache size] [result cache]: execute run requests that arrive on a Unix domain socket.\n";
+		cout << "client <socket> [request]: send the request or every line of stdin to a server and print the answers.\n";
+		cout << "Requests: run <machine> [memory] [head position] [max steps], stats, shutdown\n";
+		cout << "Runs are answered with ok <state> <memory> <head position> <steps> <halted | budget>, budget if max steps ran out first.\n";
+		cout << "stress <module path> [cases] [seed] [max steps]: run random machines on every engine and random programs\n";
+		cout << "compiled with every combination of optimizations, compare the results and report the speed of each engine.\n";
 		exit(EXIT_FAILURE);
 	}
 
 	try {
 		string filename = argv[1];
+		if(filename == "serve" && argc >= 3) {
+			Server server(argv[2], argc >= 4 ? stoul(argv[3]) : 0, argc >= 5 ? stoul(argv[4]) : DEFAULT_MACHINE_CACHE, argc >= 6 ? argv[5] : "");
+			server.run();
+			return 0;
+		}
+		if(filename == "stress" && argc >= 3) {
+			uint64_t seed = argc >= 5 ? stoull(argv[4]) : static_cast<uint64_t>(chrono::steady_clock::now().time_since_epoch().count());
+			cout << "Seed " << INFO_TEXT << seed << DEFAULT_TEXT << '\n';
+			Stress stress(argv[2], seed, argc >= 6 ? stoul(argv[5]) : DEFAULT_STRESS_STEPS);
+			size_t failures = stress.run(argc >= 4 ? stoul(argv[3]) : DEFAULT_STRESS_CASES, cout);
+			stress.report(cout);
+			return failures == 0 ? 0 : EXIT_FAILURE;
+		}
+		if(filename == "client" && argc >= 3) {
+			Client client(argv[2]);
+			if(argc >= 4) {
+				string request = argv[3];
+				for(int i=4; i<argc; ++i) request += string(" ") + argv[i];
+				istringstream in(request);
+				client.pipe(in, cout);
+			} else {
+				client.pipe(cin, cout);
+			}
+			return 0;
+		}
+
 		size_t dot_pos = filename.find_last_of('.');
 		string basename = filename.substr(0, dot_pos);
 		string extension = filename.substr(dot_pos + 1, filename.size() - (dot_pos + 1));
 
 		if(("." + extension) == AQUA_COMPILED_EXT) {
 			Module module(basename);
+
+			if(argc >= 5 && argv[4][0] == 'm') {
+				size_t lanes = argv[4][1] == '\0' ? DEFAULT_BATCH_LANES : stoul(argv[4] + 1);
+				size_t default_head = argc >= 4 ? stoul(argv[3]) : 0;
+				string buffer;
+				vector<string_view> lines;
+				if(!Utils::readFile(argv[2], buffer, lines)) {
+					throw runtime_error(string("main: Could not read ") + argv[2]);
+				}
+
+				vector<BatchJob> jobs;
+				vector<string_view> tokens;
+				for(auto line : lines) {
+					// blank lines and repeated spaces don't make jobs
+					Utils::split(line, DELIM, tokens);
+					tokens.erase(remove_if(tokens.begin(), tokens.end(), [](string_view t) {return t.empty();}), tokens.end());
+					if(tokens.empty()) continue;
+					BatchJob job;
+					job.mem = string(tokens[0]);
+					job.head_pos = tokens.size() >= 2 ? stoul(string(tokens[1])) : default_head;
+					jobs.push_back(move(job));
+				}
+
+				BatchExecutor be(module, lanes);
+				vector<BatchResult> results;
+				auto start_time = chrono::high_resolution_clock::now();
+				be.run(jobs, results);
+				auto elapsed = chrono::high_resolution_clock::now() - start_time;
+				auto elapsed_us = chrono::duration_cast<chrono::microseconds>(elapsed).count();
+
+				size_t steps = 0;
+				for(auto& r : results) {
+					if(!r.error.empty()) {
+						cout << FAULT_TEXT << r.error << DEFAULT_TEXT << '\n';
+						continue;
+					}
+					cout << r.state << ' ' << r.mem << ' ' << r.head_pos << ' ' << r.steps << '\n';
+					steps += r.steps;
+				}
+				cout << jobs.size() << " memories, " << steps << " steps in " << INFO_TEXT << elapsed_us << " µs" << DEFAULT_TEXT;
+				if(elapsed_us > 0) cout << " (" << steps * 1000000 / static_cast<size_t>(elapsed_us) << " steps/s)";
+				cout << "\nEngine: " << BatchExecutor::isaName(BatchExecutor::bestIsa()) << ", " << be.fallbacks() << " fallbacks" << endl;
+				return 0;
+			}
+
+			string mem = argc >= 3 ? argv[2] : "0";
+			size_t head_pos = argc >= 4 ? stoul(argv[3]) : 0;
+			if(head_pos >= mem.size()) {
+				throw runtime_error("main: Head position outside of memory");
+			}
+
 			Executor e(module);
-			if(argc >= 3) {
-				e.setMem(argv[2]);
-				if(argc >= 4) {
-					e.setHeadPos(stoul(argv[3]));
+			e.setMem(mem);
+			e.setHeadPos(head_pos);
+
+			if(argc >= 5 && string(argv[4]) == "r") {
+				// with a result cache, runs that have been done before aren't executed again
+				unique_ptr<ResultCache> results;
+				string table_hash;
+				CachedResult cached;
+				if(argc >= 6) {
+					results = make_unique<ResultCache>(argv[5]);
+					table_hash = ResultCache::tableHash(e.table());
+				}
+
+				auto start_time = chrono::high_resolution_clock::now();
+				bool hit = results && results->find(table_hash, mem, head_pos, SIZE_MAX, cached);
+				if(!hit) {
+					try {
+						cached.steps = e.run();
+						cached.halted = cached.steps > 0 && e.done();
+					} catch(runtime_error& err) {
+						cached.error = err.what();
+					}
+					cached.state = e.state();
+					cached.mem = e.mem();
+					cached.head_pos = e.headPos();
+					if(results) results->insert(table_hash, mem, head_pos, SIZE_MAX, cached);
+				}
+				auto elapsed = chrono::high_resolution_clock::now() - start_time;
+				auto elapsed_us = chrono::duration_cast<chrono::microseconds>(elapsed).count();
+
+				if(results) {
+					cout << "Result cache: " << INFO_TEXT << (hit ? "hit" : "miss") << DEFAULT_TEXT << " (" << results->total_hits() << " hits, "
+						 << results->total_misses() << " misses, " << results->total_saved_steps() << " steps saved in total)\n";
+					results->save();
 				}
+				if(!cached.error.empty()) throw runtime_error(cached.error);
+
+				cout << "In state: " << INFO_TEXT << cached.state << DEFAULT_TEXT << '\n';
+				cout << cached.mem << '\n' << string(cached.head_pos, ' ') << "↑\n";
+				cout << cached.steps << " steps in " << INFO_TEXT << elapsed_us << " µs" << DEFAULT_TEXT;
+				if(elapsed_us > 0) cout << " (" << cached.steps * 1000000 / static_cast<size_t>(elapsed_us) << " steps/s)";
+				cout << endl;
+				return 0;
 			}
-			else {
-				e.setMem("0");
+
+			if(argc >= 5 && argv[4][0] == 'b') {
+				size_t block_size = argv[4][1] == '\0' ? DEFAULT_BLOCK_SIZE : stoul(argv[4] + 1);
+				BlockExecutor be(module, block_size);
+				be.setMem(mem);
+				be.setHeadPos(head_pos);
+
+				auto start_time = chrono::high_resolution_clock::now();
+				size_t steps = be.run();
+				auto elapsed = chrono::high_resolution_clock::now() - start_time;
+				auto elapsed_us = chrono::duration_cast<chrono::microseconds>(elapsed).count();
+
+				cout << "In state: " << INFO_TEXT << be.state() << DEFAULT_TEXT << '\n';
+				cout << be.mem() << '\n' << string(be.headPos(), ' ') << "↑\n";
+				cout << steps << " steps in " << INFO_TEXT << elapsed_us << " µs" << DEFAULT_TEXT;
+				if(elapsed_us > 0) cout << " (" << steps * 1000000 / static_cast<size_t>(elapsed_us) << " effective steps/s)";
+				size_t lookups = be.cache_hits() + be.cache_misses();
+				cout << "\nBlock cache: " << be.cache_hits() << " hits, " << be.cache_misses() << " misses";
+				if(lookups > 0) cout << " (" << be.cache_hits() * 100 / lookups << "% hit rate)";
+				cout << endl;
+				return 0;
 			}
 
 			/*
@@ -74,17 +233,30 @@ auto main(int argc, char* argv[]) -> int {
 		else if(("." + extension) == AQUA_SOURCE_EXT) {
 			string mod_path;
 			uint verbosity = 1;
+			bool emit_header = false;
+			bool write_profile = false;
+			bool write_trace = false;
+			uint optimizations = OPT_ALL;
 
 			if(argc >= 3) {
 				mod_path = argv[2];
 				if(argc >= 4) {
-					if(string(argv[3]) == "q") verbosity = 0;
-					else if(string(argv[3]) == "v") verbosity = 2;
+					for(const char* flag = argv[3]; *flag != '\0'; ++flag) {
+						if(*flag == 'q') verbosity = 0;
+						else if(*flag == 'v') verbosity = 2;
+						else if(*flag == 'h') emit_header = true;
+						else if(*flag == 'p') write_profile = true;
+						else if(*flag == 't') write_trace = true;
+						else if(*flag == 's') optimizations &= ~OPT_SLICE;
+						else if(*flag == 'n') optimizations &= ~OPT_NOP;
+						else if(*flag == 'e') optimizations &= ~OPT_ERASE;
+					}
 				}
 			}
 
 			vector<string> result {};
-			Compiler::compile(filename, result, mod_path, verbosity);
+			Profiler profiler;
+			Compiler::compile(filename, result, mod_path, verbosity, (write_profile || write_trace) ? &profiler : nullptr, optimizations);
 			if(verbosity == 2) {
 				cout << "\n\n";
 				for(auto& s : result) {
@@ -92,6 +264,24 @@ auto main(int argc, char* argv[]) -> int {
 				}
 			}
 			Utils::writeFile(basename + AQUA_COMPILED_EXT, result);
+
+			if(write_profile) {
+				vector<string> profile;
+				profiler.writeJson(profile);
+				Utils::writeFile(basename + AQUA_PROFILE_EXT, profile);
+			}
+			if(write_trace) {
+				vector<string> trace;
+				profiler.writeTrace(trace);
+				Utils::writeFile(basename + AQUA_TRACE_EXT, trace);
+			}
+
+			if(emit_header) {
+				Module module(basename);
+				Compiler::emitHeader(Table(module), basename, result);
+				Utils::writeFile(basename + AQUA_HEADER_EXT, result);
+				if(verbosity > 0) cout << "Header written to " << INFO_TEXT << basename + AQUA_HEADER_EXT << DEFAULT_TEXT << '\n';
+			}
 			cout << endl;
 		}
 
@@ -3,64 +3,227 @@
 #include "utils.h"
 #include <vector>
 #include <stdexcept>
+#include <algorithm>
+#include <functional>
 using namespace std;
 
+static constexpr uint32_t EMPTY_SLOT = UINT32_MAX;
+
 Module::Module(const string& name) : Module(name, "") {}
 
-Module::Module(const string& name, const string& mod_path) : m_name(name) {
-	vector<string> lines;
+Module::Module(const string& name, const string& mod_path) : m_name(name), m_alphabet(DEFAULT_ALPHABET) {
+	string buffer;
+	vector<string_view> lines;
 	// find file here or in mod_path
-	bool found = Utils::readFile(name + AQUA_COMPILED_EXT, lines);
-	if(!found) found = Utils::readFile(mod_path + name + AQUA_COMPILED_EXT, lines);
+	bool found = Utils::readFile(name + AQUA_COMPILED_EXT, buffer, lines);
+	if(!found) found = Utils::readFile(mod_path + name + AQUA_COMPILED_EXT, buffer, lines);
 
 	if(found) {
+		// state names are interned into one buffer that can't outgrow the file, so a load only allocates a few buffers
+		m_names.reserve(buffer.size());
+		m_name_spans.reserve(lines.size());
+		m_rules.reserve(lines.size());
+		size_t slot_count = 16;
+		while(slot_count < 2 * lines.size()) slot_count *= 2;
+		vector<uint32_t> slots(slot_count, EMPTY_SLOT);
+		vector<string_view> tokens; // reused for every line
+		uint32_t old_state = EMPTY_SLOT; // rules of a state usually follow each other, so the last one is tried first
 		for(auto& l : lines) {
-			if(l[0] == COMMENT_CHAR) continue;
+			if(l.empty() || l[0] == COMMENT_CHAR) continue;
+
+			if(l[0] == ACTION_CHAR) { // the only action allowed in compiled files declares additional symbols
+				if(l.compare(1, ALPHABET_STRING.size() + 1, ALPHABET_STRING + ' ') != 0) {
+					throw runtime_error("Module: invalid action: " + string(l));
+				}
+				extendAlphabet(m_alphabet, string(l.substr(ALPHABET_STRING.size() + 2)));
+				continue;
+			}
 
+			Utils::split(l, DELIM, tokens);
 			if(m_end_states.empty()) { // read line as state header
-				Utils::split(l, DELIM, m_end_states);
-				if(m_end_states.size() < 2) {
-					throw runtime_error("Module: invalid state header: " + l);
+				if(tokens.size() < 2) {
+					throw runtime_error("Module: invalid state header: " + string(l));
+				}
+				m_start_state = intern(tokens[0], slots);
+				for(size_t i=1; i<tokens.size(); ++i) {
+					m_end_states.push_back(intern(tokens[i], slots));
 				}
-				m_start_state = m_end_states[0];
-				m_end_states.erase(m_end_states.begin());
 			} else { // read line as rule
-				vector<string> tokens;
-				Utils::split(l, DELIM, tokens);
 				if(tokens.size() != TOKEN_COUNT) {
-					throw runtime_error("Module: invalid rule length: " + l);
+					throw runtime_error("Module: invalid rule length: " + string(l));
 				}
 
-				Rule new_rule;
-
-				// read states
-				new_rule.old_state = tokens[0];
-				new_rule.new_state = tokens[2];
-
 				// parse chars
-				if(tokens[1].size() > 1 || tokens[3].size() > 1) {
-					throw runtime_error("Module: Character token too large at: " + l);
+				if(tokens[1].size() != 1 || tokens[3].size() != 1) {
+					throw runtime_error("Module: Character token too large at: " + string(l));
 				}
-				if((tokens[1][0] != ZERO_CHAR && tokens[1][0] != ONE_CHAR) || (tokens[3][0] != ZERO_CHAR && tokens[3][0] != ONE_CHAR)) {
-					throw runtime_error("Module: Invalid character token at: " + l);
+				if(m_alphabet.find(tokens[1][0]) == string::npos || m_alphabet.find(tokens[3][0]) == string::npos) {
+					throw runtime_error("Module: Invalid character token at: " + string(l));
 				}
-				new_rule.old_char = tokens[1][0];
-				new_rule.new_char = tokens[3][0];
 
 				// parse move direction
-				if(tokens[4][0] == LEFT_CHAR) {
-					new_rule.dir = LEFT;
+				MoveDir dir = NOP;
+				char move = tokens[4].empty() ? '\0' : tokens[4][0];
+				if(move == LEFT_CHAR) {
+					dir = LEFT;
 				}
-				else if(tokens[4][0] == RIGHT_CHAR) {
-					new_rule.dir = RIGHT;
+				else if(move == RIGHT_CHAR) {
+					dir = RIGHT;
 				}
-				else if(tokens[4][0] == NOP_CHAR) {
-					new_rule.dir = NOP;
+				else if(move != NOP_CHAR) {
+					throw runtime_error("Module: Invalid move token at:" + string(l));
 				}
-				else throw runtime_error("Module: Invalid move token at:" + l);
 
-				m_rules.push_back(new_rule);
+				if(old_state == EMPTY_SLOT || state(old_state) != tokens[0]) old_state = intern(tokens[0], slots);
+				m_rules.push_back({old_state, tokens[1][0], intern(tokens[2], slots), tokens[3][0], dir});
 			}
 		}
+		if(m_end_states.empty()) {
+			throw runtime_error("Module: No state header in " + name + AQUA_COMPILED_EXT);
+		}
 	} else throw runtime_error("Module: File " + mod_path + name + AQUA_COMPILED_EXT + " not found!");
 }
+
+auto Module::intern(string_view name, vector<uint32_t>& slots) -> uint32_t {
+	// keep the table at most half full
+	if(2 * (m_name_spans.size() + 1) > slots.size()) {
+		vector<uint32_t> grown(max(2 * slots.size(), size_t(16)), EMPTY_SLOT);
+		for(uint32_t i=0; i<m_name_spans.size(); ++i) {
+			size_t slot = hash<string_view>()(state(i)) & (grown.size() - 1);
+			while(grown[slot] != EMPTY_SLOT) slot = (slot + 1) & (grown.size() - 1);
+			grown[slot] = i;
+		}
+		slots = move(grown);
+	}
+
+	const size_t mask = slots.size() - 1;
+	for(size_t slot = hash<string_view>()(name) & mask; ; slot = (slot + 1) & mask) {
+		if(slots[slot] == EMPTY_SLOT) {
+			slots[slot] = static_cast<uint32_t>(m_name_spans.size());
+			m_name_spans.emplace_back(static_cast<uint32_t>(m_names.size()), static_cast<uint32_t>(name.size()));
+			m_names.append(name);
+			return slots[slot];
+		}
+		if(state(slots[slot]) == name) return slots[slot];
+	}
+}
+
+void Module::scope(const string& prefix) {
+	string names;
+	names.reserve(m_names.size() + m_name_spans.size() * prefix.size());
+	for(auto& span : m_name_spans) {
+		uint32_t offset = static_cast<uint32_t>(names.size());
+		names.append(prefix);
+		names.append(m_names, span.first, span.second);
+		span = {offset, static_cast<uint32_t>(span.second + prefix.size())};
+	}
+	m_names = move(names);
+}
+
+auto Module::branch(const string& name, const string& alphabet) -> Module {
+	Module module;
+	module.m_name = name;
+	module.m_alphabet = alphabet;
+	vector<uint32_t> slots;
+	module.m_start_state = module.intern("start", slots); // longer than one character, so it can never clash with an end state
+
+	for(char c : alphabet) {
+		module.m_end_states.push_back(module.intern(string_view(&c, 1), slots));
+		module.m_rules.push_back({module.m_start_state, c, module.m_end_states.back(), c, NOP});
+	}
+	return module;
+}
+
+auto Module::isValidSymbol(char c) -> bool {
+	// exclude everything that would break the rule format or binding syntax, MAX_SYMBOLS counts the rest
+	return static_cast<unsigned char>(c) > ' ' && c != '\x7f' && c != BINDING_OPEN && c != BINDING_CLOSE && c != EXPLICIT_STATE && c != COMMENT_CHAR;
+}
+
+void Module::extendAlphabet(string& alphabet, const string& symbols) {
+	for(char c : symbols) {
+		if(c == ' ') continue;
+		if(!isValidSymbol(c)) {
+			throw runtime_error("Module: Invalid symbol " + string(1, c) + " in alphabet " + symbols);
+		}
+		if(alphabet.find(c) != string::npos) continue;
+		if(alphabet.size() == MAX_SYMBOLS) {
+			throw runtime_error("Module: Alphabet exceeds " + to_string(MAX_SYMBOLS) + " symbols");
+		}
+		alphabet.push_back(c);
+	}
+}
+
+void Module::analyze() {
+	m_entry_points.clear();
+	m_reachable_end_states.assign(m_end_states.size(), false);
+
+	// index rules by old state, the first rule for a symbol wins like in the executor
+	vector<vector<size_t>> state_rules(state_count());
+	for(size_t i=0; i<m_rules.size(); ++i) {
+		state_rules[m_rules[i].old_state].push_back(i);
+	}
+	auto findRule = [&](uint32_t state, char c) -> const ModuleRule* {
+		for(size_t i : state_rules[state]) {
+			if(m_rules[i].old_char == c) return &m_rules[i];
+		}
+		return nullptr;
+	};
+
+	// the first end state with a name counts, like a search by name would find it
+	vector<size_t> end_indices(state_count(), m_end_states.size());
+	for(size_t i=m_end_states.size(); i-- > 0; ) {
+		end_indices[m_end_states[i]] = i;
+	}
+	auto endIndex = [&](uint32_t state) -> size_t {
+		return end_indices[state];
+	};
+
+	for(char c : m_alphabet) {
+		EntryPoint ep {c, m_start_state, c, false, {}};
+
+		// skip leading NOP rules, a NOP loop would hang at runtime, so give up on it after visiting every rule once
+		const ModuleRule* r = findRule(ep.state, ep.new_symbol);
+		for(size_t hops = 0; r != nullptr && r->dir == NOP && endIndex(ep.state) == m_end_states.size() && hops < m_rules.size(); ++hops) {
+			ep.state = r->new_state;
+			ep.new_symbol = r->new_char;
+			r = findRule(ep.state, ep.new_symbol);
+		}
+
+		size_t end_index = endIndex(ep.state);
+		if(end_index < m_end_states.size()) {
+			ep.exits = true;
+			m_reachable_end_states[end_index] = true;
+			m_entry_points.push_back(ep);
+			continue;
+		}
+		if(r == nullptr) continue; // this symbol faults at runtime, entering the module with it is not possible
+
+		// collect the first rule and everything reachable from its new state
+		vector<bool> used(m_rules.size(), false);
+		used[static_cast<size_t>(r - m_rules.data())] = true;
+		vector<uint32_t> todo {r->new_state};
+		vector<bool> visited(state_count(), false);
+		while(!todo.empty()) {
+			uint32_t state = todo.back();
+			todo.pop_back();
+			if(visited[state]) continue;
+			visited[state] = true;
+
+			end_index = endIndex(state);
+			if(end_index < m_end_states.size()) { // end states are bound outside of the module
+				m_reachable_end_states[end_index] = true;
+				continue;
+			}
+
+			for(size_t i : state_rules[state]) {
+				used[i] = true;
+				todo.push_back(m_rules[i].new_state);
+			}
+		}
+
+		for(size_t i=0; i<used.size(); ++i) {
+			if(used[i]) ep.rules.push_back(i);
+		}
+		m_entry_points.push_back(ep);
+	}
+}
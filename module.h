@@ -3,7 +3,9 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
 #include <utility>
+#include <cstdint>
 
 enum MoveDir {
 	LEFT,
@@ -22,24 +24,76 @@ struct Rule {
 		old_state(std::move(_old_state)), old_char(_old_char), new_state(std::move(_new_state)), new_char(_new_char), dir(_dir) {}
 };
 
-static const std::string DELIM = " ";
+/*
+ * A rule of a loaded module, its states are indices into the module's state names.
+ */
+struct ModuleRule {
+	uint32_t old_state;
+	char old_char;
+	uint32_t new_state;
+	char new_char;
+	MoveDir dir;
+};
+
+/*
+ * What happens when a module is entered with a given symbol under the head:
+ * the leading NOP rules are skipped, state and new_symbol are where the
+ * module's body takes over. If state is an end state, no body is needed at all.
+ */
+struct EntryPoint {
+	char symbol;
+	uint32_t state;
+	char new_symbol;
+	bool exits;
+	std::vector<size_t> rules; // indices of all rules reachable from this entry point
+};
+
+static constexpr char DELIM = ' ';
 static constexpr size_t TOKEN_COUNT = 5;
 
 class Module {
 	std::string m_name {};
-	std::string m_start_state {};
-	std::vector<std::string> m_end_states {};
-	std::vector<Rule> m_rules {};
+	std::string m_alphabet {};
+	std::string m_names {}; // every state name once, one after another
+	std::vector<std::pair<uint32_t, uint32_t>> m_name_spans {}; // offset and length of each state's name
+	uint32_t m_start_state = 0;
+	std::vector<uint32_t> m_end_states {};
+	std::vector<ModuleRule> m_rules {};
+	std::vector<EntryPoint> m_entry_points {};
+	std::vector<bool> m_reachable_end_states {};
+
+	Module() = default;
+
+	// returns the index of the state with that name, slots is an open addressing table of the indices
+	auto intern(std::string_view name, std::vector<uint32_t>& slots) -> uint32_t;
 
 public:
 	explicit Module(const std::string& name);
 	Module(const std::string& name, const std::string& mod_path);
 	//static auto parse(const std::string& data) -> Rule;
 
+	// creates a T-like module with one end state per symbol of the alphabet, named after that symbol
+	static auto branch(const std::string& name, const std::string& alphabet) -> Module;
+
+	static auto isValidSymbol(char c) -> bool;
+	static void extendAlphabet(std::string& alphabet, const std::string& symbols);
+
+	// puts prefix in front of every state name, the indices stay the same
+	void scope(const std::string& prefix);
+	// computes entry points and end state reachability
+	void analyze();
+
 	auto name() -> std::string& {return m_name;}
-	auto start_state() -> std::string& {return m_start_state;}
-	auto end_states() -> std::vector<std::string>& {return m_end_states;}
-	auto rules() -> std::vector<Rule>& {return m_rules;}
+	auto alphabet() -> std::string& {return m_alphabet;}
+	auto state_count() const -> size_t {return m_name_spans.size();}
+	auto state(uint32_t index) const -> std::string_view {
+		return std::string_view(m_names).substr(m_name_spans[index].first, m_name_spans[index].second);
+	}
+	auto start_state() const -> uint32_t {return m_start_state;}
+	auto end_states() const -> const std::vector<uint32_t>& {return m_end_states;}
+	auto rules() const -> const std::vector<ModuleRule>& {return m_rules;}
+	auto entry_points() const -> const std::vector<EntryPoint>& {return m_entry_points;}
+	auto reachable_end_states() const -> const std::vector<bool>& {return m_reachable_end_states;}
 };
 
 #endif // RULEPARSER_H
@@ -0,0 +1,161 @@
+#include "profiler.h"
+#include <malloc.h>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <new>
+using namespace std;
+
+// per thread, so no two threads share the counters, and only counted while a pass is open on the thread
+static thread_local size_t open_passes = 0;
+static thread_local size_t allocation_count = 0;
+static thread_local size_t allocation_bytes = 0;
+// bytes allocated minus bytes freed while passes were open, blocks freed on another thread stay live
+static thread_local long long live_bytes = 0;
+static thread_local long long peak_live_bytes = 0;
+
+auto operator new(size_t size) -> void* {
+	void* p = malloc(size == 0 ? 1 : size);
+	if(p == nullptr) throw bad_alloc();
+	if(open_passes > 0) {
+		++allocation_count;
+		allocation_bytes += size;
+		live_bytes += static_cast<long long>(malloc_usable_size(p)); // delete doesn't always get the size
+		peak_live_bytes = max(peak_live_bytes, live_bytes);
+	}
+	return p;
+}
+
+auto operator new[](size_t size) -> void* {
+	return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+	if(open_passes > 0) live_bytes -= static_cast<long long>(malloc_usable_size(p));
+	free(p);
+}
+
+void operator delete[](void* p) noexcept {
+	operator delete(p);
+}
+
+void operator delete(void* p, size_t /*size*/) noexcept {
+	operator delete(p);
+}
+
+void operator delete[](void* p, size_t /*size*/) noexcept {
+	operator delete(p);
+}
+
+auto jsonCount(size_t count) -> string {
+	return count == NOT_COUNTED ? "null" : to_string(count);
+}
+
+auto jsonString(const string& text) -> string {
+	string json = "\"";
+	for(char c : text) {
+		if(static_cast<unsigned char>(c) < 0x20) { // control characters are not allowed in JSON strings
+			char escaped[7];
+			snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+			json += escaped;
+			continue;
+		}
+		if(c == '"' || c == '\\') json.push_back('\\');
+		json.push_back(c);
+	}
+	return json + '"';
+}
+
+Profiler::Profiler() : m_origin(chrono::steady_clock::now()) {}
+
+Profiler::~Profiler() {
+	open_passes -= m_open.size();
+}
+
+auto Profiler::now() const -> long long {
+	return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - m_origin).count();
+}
+
+auto Profiler::allocations() -> size_t {
+	return allocation_count;
+}
+
+auto Profiler::allocatedBytes() -> size_t {
+	return allocation_bytes;
+}
+
+
+void Profiler::begin(const string& name, const string& category) {
+	PassRecord record;
+	record.name = name;
+	record.category = category;
+	record.depth = m_open.size();
+	m_records.push_back(record);
+
+	m_open.push_back(m_records.size() - 1);
+	m_open_allocs.emplace_back();
+	m_open_allocs.back() = {allocations(), allocatedBytes(), live_bytes, peak_live_bytes};
+	peak_live_bytes = live_bytes; // the enclosing pass gets its peak back in end()
+	++open_passes;
+	m_records.back().start_us = now(); // last, so the bookkeeping above is not measured
+}
+
+void Profiler::end() {
+	long long stop = now();
+	size_t allocs = allocations();
+	size_t bytes = allocatedBytes();
+	if(m_open.empty()) return;
+	--open_passes;
+
+	PassRecord& record = m_records[m_open.back()];
+	const OpenPass& open = m_open_allocs.back();
+	record.duration_us = stop - record.start_us;
+	record.allocations = allocs - open.allocations;
+	record.allocated_bytes = bytes - open.allocated_bytes;
+	record.peak_live_bytes = static_cast<size_t>(peak_live_bytes - open.live_bytes);
+	peak_live_bytes = max(peak_live_bytes, open.peak_live_bytes);
+
+	m_last_ended = m_open.back();
+	m_open.pop_back();
+	m_open_allocs.pop_back();
+}
+
+void Profiler::count(size_t rules, size_t states) {
+	if(m_last_ended >= m_records.size()) return;
+	m_records[m_last_ended].rules = rules;
+	m_records[m_last_ended].states = states;
+}
+
+void Profiler::writeJson(vector<string>& result) const {
+	result.clear();
+	result.emplace_back("{");
+	result.emplace_back("\t\"passes\": [");
+	for(size_t i=0; i<m_records.size(); ++i) {
+		const PassRecord& r = m_records[i];
+		result.push_back("\t\t{\"name\": " + jsonString(r.name) + ", \"category\": " + jsonString(r.category)
+						 + ", \"depth\": " + to_string(r.depth)
+						 + ", \"start_us\": " + to_string(r.start_us) + ", \"duration_us\": " + to_string(r.duration_us)
+						 + ", \"rules\": " + to_string(r.rules) + ", \"states\": " + jsonCount(r.states)
+						 + ", \"allocations\": " + to_string(r.allocations) + ", \"allocated_bytes\": " + to_string(r.allocated_bytes)
+						 + ", \"peak_live_bytes\": " + to_string(r.peak_live_bytes) + "}"
+						 + (i + 1 < m_records.size() ? "," : ""));
+	}
+	result.emplace_back("\t]");
+	result.emplace_back("}");
+}
+
+void Profiler::writeTrace(vector<string>& result) const {
+	result.clear();
+	result.emplace_back("{\"traceEvents\": [");
+	for(size_t i=0; i<m_records.size(); ++i) {
+		const PassRecord& r = m_records[i];
+		result.push_back("\t{\"name\": " + jsonString(r.name) + ", \"cat\": " + jsonString(r.category)
+						 + ", \"ph\": \"X\", \"pid\": 1, \"tid\": 1"
+						 + ", \"ts\": " + to_string(r.start_us) + ", \"dur\": " + to_string(r.duration_us)
+						 + ", \"args\": {\"rules\": " + to_string(r.rules) + ", \"states\": " + jsonCount(r.states)
+						 + ", \"allocations\": " + to_string(r.allocations) + ", \"allocated_bytes\": " + to_string(r.allocated_bytes)
+						 + ", \"peak_live_bytes\": " + to_string(r.peak_live_bytes) + "}}"
+						 + (i + 1 < m_records.size() ? "," : ""));
+	}
+	result.emplace_back("], \"displayTimeUnit\": \"ms\"}");
+}
@@ -0,0 +1,67 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+static constexpr size_t NOT_COUNTED = SIZE_MAX;
+
+struct PassRecord {
+	std::string name;
+	std::string category;
+	long long start_us = 0; // relative to the creation of the profiler
+	long long duration_us = 0;
+	size_t depth = 0; // nesting level, passes can contain other passes
+	size_t rules = 0;
+	size_t states = NOT_COUNTED;
+	size_t allocations = 0;
+	size_t allocated_bytes = 0;
+	size_t peak_live_bytes = 0; // most heap bytes the pass held at once, beyond what was live when it began
+};
+
+/*
+ * Records wall time, heap allocations and memory for named (possibly nested)
+ * passes. Allocations are counted by a replaced global operator new in
+ * thread local counters, only while a pass is open on the allocating thread,
+ * and operator delete takes freed blocks off the live bytes. Passes have to
+ * begin and end on the same thread. Everywhere else operator new and delete
+ * only check one thread local counter.
+ */
+class Profiler {
+	std::chrono::steady_clock::time_point m_origin;
+	std::vector<PassRecord> m_records {};
+	std::vector<size_t> m_open {}; // indices of passes that have not ended yet
+	struct OpenPass {
+		size_t allocations;
+		size_t allocated_bytes;
+		long long live_bytes;
+		long long peak_live_bytes; // of the enclosing pass
+	};
+	std::vector<OpenPass> m_open_allocs {};
+	size_t m_last_ended = SIZE_MAX;
+
+	auto now() const -> long long;
+
+public:
+	Profiler();
+	~Profiler();
+	Profiler(const Profiler&) = delete;
+	auto operator=(const Profiler&) -> Profiler& = delete;
+
+	static auto allocations() -> size_t;
+	static auto allocatedBytes() -> size_t;
+
+	void begin(const std::string& name, const std::string& category = "pass");
+	void end();
+	// sets rule and state count of the pass that ended last, states that weren't counted are written as null
+	void count(size_t rules, size_t states = NOT_COUNTED);
+
+	auto records() const -> const std::vector<PassRecord>& {return m_records;}
+
+	void writeJson(std::vector<std::string>& result) const;
+	void writeTrace(std::vector<std::string>& result) const; // Chrome trace event format
+};
+
+#endif // PROFILER_H
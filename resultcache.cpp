@@ -0,0 +1,319 @@
+#include "resultcache.h"
+#include "module.h"
+#include "utils.h"
+#include "globals.h"
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <vector>
+using namespace std;
+
+/*
+ * Index syntax, one entry per line:
+ * key table_hash head_pos max_steps mem state lead length =trimmed_mem new_head_pos steps halted [error]
+ * The trimmed memory has a prefix so that it is never empty, halted is 1 if an
+ * end state was reached and 0 if max_steps ran out. The statistics
+ * file holds one line with the action char, the statistics of all sessions.
+ */
+static const string STATS_STRING = "stats";
+static const string STATS_EXT = ".stats";
+static const string LOCK_EXT = ".lock";
+
+// exclusive lock on a file next to the cache, released when it goes out of scope
+class FileLock {
+	int m_fd;
+
+public:
+	explicit FileLock(const string& path) : m_fd(open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644)) {
+		if(m_fd >= 0 && flock(m_fd, LOCK_EX) != 0) {
+			close(m_fd);
+			m_fd = -1;
+		}
+	}
+	~FileLock() {
+		if(m_fd >= 0) close(m_fd);
+	}
+	FileLock(const FileLock&) = delete;
+	auto operator=(const FileLock&) -> FileLock& = delete;
+
+	auto locked() const -> bool {return m_fd >= 0;}
+};
+
+// writes a temporary file with a unique name and renames it over the old one, readers never see half of it
+static auto replaceFile(const string& path, const vector<string>& lines) -> bool {
+	string temp_path = path + ".XXXXXX";
+	int fd = mkstemp(temp_path.data());
+	if(fd < 0) return false;
+	fchmod(fd, 0644); // mkstemp only lets the owner read
+	close(fd);
+
+	if(!Utils::writeFile(temp_path, lines) || rename(temp_path.c_str(), path.c_str()) != 0) {
+		unlink(temp_path.c_str());
+		return false;
+	}
+	return true;
+}
+
+// two FNV-1a hashes with different offsets, as 32 hex digits
+class Hash {
+	uint64_t m_a = 0xcbf29ce484222325;
+	uint64_t m_b = 0x84222325cbf29ce4;
+
+public:
+	void add(string_view data) {
+		for(unsigned char c : data) {
+			m_a = (m_a ^ c) * 0x100000001b3;
+			m_b = (m_b ^ c) * 0x100000001b3;
+		}
+		m_b = (m_b ^ (data.size() & 0xff)) * 0x100000001b3; // keeps "ab" "c" apart from "a" "bc"
+	}
+
+	void add(uint64_t value) {
+		add(string_view(reinterpret_cast<const char*>(&value), sizeof(value)));
+	}
+
+	auto hex() const -> string {
+		char text[33];
+		snprintf(text, sizeof(text), "%016llx%016llx", static_cast<unsigned long long>(m_a), static_cast<unsigned long long>(m_b));
+		return text;
+	}
+};
+
+ResultCache::ResultCache(string path, size_t max_bytes) : m_path(move(path)), m_max_bytes(max_bytes) {
+	vector<Entry> entries;
+	readIndex(m_path, entries); // nothing for a new cache
+	for(auto& entry : entries) add(move(entry));
+	m_dirty = false;
+
+	size_t hits = 0, misses = 0, saved_steps = 0;
+	if(readStats(m_path + STATS_EXT, hits, misses, saved_steps)) {
+		m_total_hits = hits;
+		m_total_misses = misses;
+		m_total_saved_steps = saved_steps;
+	}
+}
+
+ResultCache::~ResultCache() {
+	save();
+}
+
+auto ResultCache::tableHash(const Table& table) -> string {
+	Hash hash;
+	hash.add(table.alphabet());
+	hash.add(table.state_count());
+	hash.add(table.start_state());
+	for(uint32_t s=0; s<table.state_count(); ++s) {
+		hash.add(table.state_names()[s]);
+		hash.add(table.isEndState(s) ? 1 : 0);
+		for(size_t c=0; c<table.symbol_count(); ++c) {
+			const Transition& t = table.at(s, static_cast<uint8_t>(c));
+			hash.add((static_cast<uint64_t>(t.new_state) << 16) | (static_cast<uint64_t>(t.new_symbol) << 8) | static_cast<uint64_t>(t.dir));
+		}
+	}
+	return hash.hex();
+}
+
+auto ResultCache::key(const string& table_hash, const string& mem, size_t head_pos) -> string {
+	Hash hash;
+	hash.add(table_hash);
+	hash.add(mem);
+	hash.add(head_pos);
+	return hash.hex();
+}
+
+auto ResultCache::answers(const Entry& entry, size_t max_steps) -> bool {
+	if(entry.result.halted) return entry.result.steps <= max_steps; // a larger budget changes nothing
+	if(!entry.result.error.empty()) return entry.max_steps <= max_steps; // the fault happened within the recorded budget
+	return entry.max_steps == max_steps;
+}
+
+auto ResultCache::format(const Entry& entry) -> string {
+	const string& mem = entry.result.mem;
+	size_t lead = min(mem.find_first_not_of(ZERO_CHAR), mem.size());
+	size_t end = mem.find_last_not_of(ZERO_CHAR) + 1; // 0 if there are only blanks
+	string trimmed = end > lead ? mem.substr(lead, end - lead) : "";
+
+	string line = entry.key + DELIM + entry.table_hash + DELIM + to_string(entry.head_pos) + DELIM + to_string(entry.max_steps)
+				  + DELIM + entry.mem + DELIM + entry.result.state + DELIM + to_string(lead) + DELIM + to_string(mem.size())
+				  + DELIM + '=' + trimmed + DELIM + to_string(entry.result.head_pos) + DELIM + to_string(entry.result.steps)
+				  + DELIM + (entry.result.halted ? '1' : '0');
+	if(!entry.result.error.empty()) line += DELIM + entry.result.error;
+	return line;
+}
+
+auto ResultCache::parse(string_view line, Entry& entry) -> bool {
+	static constexpr size_t FIELD_COUNT = 12;
+	vector<string_view> tokens;
+	Utils::split(line, DELIM, tokens);
+	if(tokens.size() < FIELD_COUNT || tokens[8].empty() || (tokens[11] != "0" && tokens[11] != "1")) return false;
+
+	try {
+		entry.key = tokens[0];
+		entry.table_hash = tokens[1];
+		entry.head_pos = stoull(string(tokens[2]));
+		entry.max_steps = stoull(string(tokens[3]));
+		entry.mem = tokens[4];
+		entry.result.state = tokens[5];
+		size_t lead = stoull(string(tokens[6]));
+		size_t length = stoull(string(tokens[7]));
+		string_view trimmed = tokens[8].substr(1);
+		if(lead + trimmed.size() > length) return false;
+		entry.result.mem.assign(lead, ZERO_CHAR);
+		entry.result.mem.append(trimmed);
+		entry.result.mem.resize(length, ZERO_CHAR);
+		entry.result.head_pos = stoull(string(tokens[9]));
+		entry.result.steps = stoull(string(tokens[10]));
+		entry.result.halted = tokens[11] == "1";
+	} catch(exception&) { // stoull throws invalid_argument and out_of_range
+		return false;
+	}
+
+	// the error message is the rest of the line
+	if(tokens.size() > FIELD_COUNT) {
+		entry.result.error = line.substr(static_cast<size_t>(tokens[FIELD_COUNT].data() - line.data()));
+	}
+	entry.bytes = line.size() + 1;
+	return entry.key == key(entry.table_hash, entry.mem, entry.head_pos);
+}
+
+void ResultCache::add(Entry entry) {
+	auto it = m_index.find(entry.key);
+	if(it != m_index.end()) {
+		// a run that ended answers more budgets than one that ran out of steps, so it stays
+		const CachedResult& cached = it->second->result;
+		if(!entry.result.halted && entry.result.error.empty() && (cached.halted || !cached.error.empty())) return;
+		m_bytes -= it->second->bytes;
+		m_entries.erase(it->second);
+		m_index.erase(it);
+		m_size = m_entries.size();
+	}
+	if(entry.bytes > m_max_bytes) return;
+
+	m_bytes += entry.bytes;
+	m_entries.push_back(move(entry));
+	m_index[m_entries.back().key] = prev(m_entries.end());
+	m_dirty = true;
+
+	while(m_bytes > m_max_bytes) {
+		m_bytes -= m_entries.front().bytes;
+		m_index.erase(m_entries.front().key);
+		m_entries.pop_front();
+		++m_evictions;
+	}
+	m_size = m_entries.size();
+}
+
+void ResultCache::readIndex(const string& path, vector<Entry>& entries) {
+	string buffer;
+	vector<string_view> lines;
+	if(!Utils::readFile(path, buffer, lines)) return;
+
+	for(auto line : lines) {
+		Entry entry;
+		if(parse(line, entry)) entries.push_back(move(entry)); // damaged lines are dropped, the cache can always be rebuilt
+	}
+}
+
+auto ResultCache::readStats(const string& path, size_t& hits, size_t& misses, size_t& saved_steps) -> bool {
+	string buffer;
+	vector<string_view> lines, tokens;
+	if(!Utils::readFile(path, buffer, lines) || lines.empty() || lines[0].empty() || lines[0][0] != ACTION_CHAR) return false;
+
+	Utils::split(lines[0].substr(1), DELIM, tokens);
+	if(tokens.size() != 4 || tokens[0] != STATS_STRING) return false;
+	try {
+		hits = stoull(string(tokens[1]));
+		misses = stoull(string(tokens[2]));
+		saved_steps = stoull(string(tokens[3]));
+	} catch(exception&) { // the statistics start over
+		return false;
+	}
+	return true;
+}
+
+auto ResultCache::isField(const string& text) -> bool {
+	return !text.empty() && text.find_first_of(" \n\r") == string::npos;
+}
+
+auto ResultCache::find(const string& table_hash, const string& mem, size_t head_pos, size_t max_steps, CachedResult& result) -> bool {
+	lock_guard<mutex> lock(m_mutex);
+	auto it = m_index.find(key(table_hash, mem, head_pos));
+
+	// compare the inputs too, a hash collision must never return a wrong result
+	if(it == m_index.end() || it->second->table_hash != table_hash || it->second->mem != mem
+	   || it->second->head_pos != head_pos || !answers(*it->second, max_steps)) {
+		++m_misses;
+		++m_total_misses;
+		return false;
+	}
+
+	m_entries.splice(m_entries.end(), m_entries, it->second);
+	result = it->second->result;
+	++m_hits;
+	++m_total_hits;
+	m_saved_steps += result.steps;
+	m_total_saved_steps += result.steps; // the new order is only written with the next change of the entries
+	return true;
+}
+
+void ResultCache::insert(const string& table_hash, const string& mem, size_t head_pos, size_t max_steps, const CachedResult& result) {
+	// memories with characters outside the alphabet could break the index syntax
+	if(!isField(mem) || !isField(result.state) || (!result.mem.empty() && !isField(result.mem))
+	   || result.error.find_first_of("\n\r") != string::npos) return;
+	Entry entry {key(table_hash, mem, head_pos), table_hash, mem, head_pos, max_steps, result, 0};
+	entry.bytes = format(entry).size() + 1;
+
+	lock_guard<mutex> lock(m_mutex);
+	add(move(entry));
+}
+
+auto ResultCache::save() -> bool {
+	lock_guard<mutex> lock(m_mutex);
+	bool counted = m_hits != m_persisted_hits || m_misses != m_persisted_misses;
+	if(!m_dirty && !counted) return true;
+
+	FileLock file_lock(m_path + LOCK_EXT);
+	if(!file_lock.locked()) return false;
+
+	if(m_dirty) {
+		// keep what other processes saved meanwhile, as older than everything of this one
+		vector<Entry> saved;
+		readIndex(m_path, saved);
+		list<Entry> entries = move(m_entries);
+		m_entries.clear();
+		m_index.clear();
+		m_bytes = 0;
+		size_t evictions = m_evictions;
+		for(auto& entry : saved) add(move(entry));
+		for(auto& entry : entries) add(move(entry));
+		m_evictions = evictions; // only count what this session's inserts pushed out
+
+		vector<string> lines;
+		lines.reserve(m_entries.size());
+		for(auto& entry : m_entries) {
+			lines.push_back(format(entry));
+		}
+		if(!replaceFile(m_path, lines)) return false;
+		m_dirty = false;
+	}
+
+	if(counted) {
+		// add this session's counts to the ones on disk, other processes may have added theirs
+		size_t hits = 0, misses = 0, saved_steps = 0;
+		readStats(m_path + STATS_EXT, hits, misses, saved_steps);
+		hits += m_hits - m_persisted_hits;
+		misses += m_misses - m_persisted_misses;
+		saved_steps += m_saved_steps - m_persisted_saved_steps;
+		if(!replaceFile(m_path + STATS_EXT, {ACTION_CHAR + STATS_STRING + DELIM + to_string(hits) + DELIM + to_string(misses)
+											 + DELIM + to_string(saved_steps)})) return false;
+		m_total_hits = hits;
+		m_total_misses = misses;
+		m_total_saved_steps = saved_steps;
+		m_persisted_hits = m_hits;
+		m_persisted_misses = m_misses;
+		m_persisted_saved_steps = m_saved_steps;
+	}
+	return true;
+}
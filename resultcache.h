@@ -0,0 +1,103 @@
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "table.h"
+
+static constexpr size_t DEFAULT_RESULT_CACHE_BYTES = 64 << 20;
+
+struct CachedResult {
+	std::string state {};
+	std::string mem {};
+	size_t head_pos = 0;
+	size_t steps = 0;
+	bool halted = false; // an end state was reached, else max_steps ran out
+	std::string error {}; // faults are just as deterministic as results
+};
+
+/*
+ * Persistent results of machine runs, addressed by a hash of the machine's
+ * table, the initial memory and the head position. A run that halted answers
+ * every budget it fits into, one that ran out of steps only its own budget and
+ * one that faulted every budget at least as large. The memories are stored
+ * without their leading and trailing blanks. Entries are
+ * kept in one index file in least recently used order, the oldest are evicted
+ * when the file would grow beyond max_bytes. The hit statistics are kept next
+ * to it in a small file, so runs that only hit don't rewrite the index. Safe to
+ * use from several threads, and processes can share a cache: saving merges
+ * with the files on disk under a file lock.
+ */
+class ResultCache {
+	struct Entry {
+		std::string key;
+		std::string table_hash;
+		std::string mem;
+		size_t head_pos;
+		size_t max_steps; // budget of the recorded run
+		CachedResult result;
+		size_t bytes; // size of the entry's line in the index
+	};
+
+	std::string m_path;
+	size_t m_max_bytes;
+	std::mutex m_mutex {};
+	std::list<Entry> m_entries {}; // least recently used first
+	std::unordered_map<std::string, std::list<Entry>::iterator> m_index {};
+	bool m_dirty = false; // entries were inserted or evicted since the index was read or written
+	size_t m_persisted_hits = 0; // counts of this session that are in the statistics file already
+	size_t m_persisted_misses = 0;
+	size_t m_persisted_saved_steps = 0;
+
+	// changed under the mutex, but can be read any time
+	std::atomic<size_t> m_size {0};
+	std::atomic<size_t> m_bytes {0};
+	std::atomic<size_t> m_hits {0};
+	std::atomic<size_t> m_misses {0};
+	std::atomic<size_t> m_saved_steps {0}; // steps that hits didn't have to execute
+	std::atomic<size_t> m_evictions {0};
+	std::atomic<size_t> m_total_hits {0}; // including earlier sessions
+	std::atomic<size_t> m_total_misses {0};
+	std::atomic<size_t> m_total_saved_steps {0};
+
+	static auto key(const std::string& table_hash, const std::string& mem, size_t head_pos) -> std::string;
+	static auto answers(const Entry& entry, size_t max_steps) -> bool;
+	static auto format(const Entry& entry) -> std::string;
+	static auto parse(std::string_view line, Entry& entry) -> bool;
+	static auto isField(const std::string& text) -> bool;
+	static void readIndex(const std::string& path, std::vector<Entry>& entries);
+	static auto readStats(const std::string& path, size_t& hits, size_t& misses, size_t& saved_steps) -> bool;
+	void add(Entry entry);
+
+public:
+	explicit ResultCache(std::string path, size_t max_bytes = DEFAULT_RESULT_CACHE_BYTES);
+	~ResultCache();
+	ResultCache(const ResultCache&) = delete;
+	auto operator=(const ResultCache&) -> ResultCache& = delete;
+
+	// identifies a machine by everything that can change the result of a run, not by its file
+	static auto tableHash(const Table& table) -> std::string;
+
+	auto find(const std::string& table_hash, const std::string& mem, size_t head_pos, size_t max_steps, CachedResult& result) -> bool;
+	void insert(const std::string& table_hash, const std::string& mem, size_t head_pos, size_t max_steps, const CachedResult& result);
+	// writes the index if entries changed and the statistics if runs were looked up, also done by the destructor
+	auto save() -> bool;
+
+	auto hits() const -> size_t {return m_hits;}
+	auto misses() const -> size_t {return m_misses;}
+	auto saved_steps() const -> size_t {return m_saved_steps;}
+	auto evictions() const -> size_t {return m_evictions;}
+	auto total_hits() const -> size_t {return m_total_hits;}
+	auto total_misses() const -> size_t {return m_total_misses;}
+	auto total_saved_steps() const -> size_t {return m_total_saved_steps;}
+	auto size() const -> size_t {return m_size;}
+	auto bytes() const -> size_t {return m_bytes;}
+};
+
+#endif // RESULTCACHE_H
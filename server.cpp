@@ -0,0 +1,336 @@
+#include "server.h"
+#include "executor.h"
+#include "module.h"
+#include "utils.h"
+#include "globals.h"
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+using namespace std;
+
+Server::Connection::~Connection() {
+	close(fd); // the last answer has been sent when the last task lets go of the connection
+}
+
+Server::Server(string socket_path, size_t workers, size_t cache_capacity, const string& result_cache) :
+	m_socket_path(move(socket_path)), m_worker_count(workers), m_cache_capacity(max(cache_capacity, size_t(1))),
+	m_start(chrono::steady_clock::now()) {
+	if(m_worker_count == 0) m_worker_count = max(thread::hardware_concurrency(), 1u);
+	if(!result_cache.empty()) m_results = make_unique<ResultCache>(result_cache);
+}
+
+auto Server::machine(const string& path) -> Machine {
+	string basename = path;
+	if(basename.size() >= AQUA_COMPILED_EXT.size() && basename.compare(basename.size() - AQUA_COMPILED_EXT.size(), string::npos, AQUA_COMPILED_EXT) == 0) {
+		basename.resize(basename.size() - AQUA_COMPILED_EXT.size());
+	}
+
+	struct stat info {};
+	if(stat((basename + AQUA_COMPILED_EXT).c_str(), &info) != 0) {
+		throw runtime_error("Server: File " + basename + AQUA_COMPILED_EXT + " not found!");
+	}
+	const long long mtime_ns = static_cast<long long>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+	const long long size = static_cast<long long>(info.st_size);
+
+	promise<Machine> loading;
+	shared_future<Machine> cached;
+	bool loader = false;
+	{
+		lock_guard<mutex> lock(m_cache_mutex);
+		auto it = m_machine_index.find(basename);
+		if(it != m_machine_index.end() && it->second->mtime_ns == mtime_ns && it->second->size == size) {
+			++m_cache_hits;
+			m_machines.splice(m_machines.begin(), m_machines, it->second);
+			cached = it->second->machine;
+		} else {
+			++m_cache_misses;
+			if(it != m_machine_index.end()) {
+				m_machines.erase(it->second);
+				m_machine_index.erase(it);
+			}
+			cached = loading.get_future().share();
+			m_machines.push_front({basename, mtime_ns, size, cached});
+			m_machine_index[basename] = m_machines.begin();
+			if(m_machines.size() > m_cache_capacity) {
+				m_machine_index.erase(m_machines.back().path);
+				m_machines.pop_back();
+			}
+			loader = true;
+		}
+	}
+
+	// load outside of the lock, so other machines can still be served meanwhile
+	if(loader) {
+		try {
+			Module module(basename);
+			Machine loaded {Executor::prepare(module), ""};
+			if(m_results) loaded.table_hash = ResultCache::tableHash(*loaded.table);
+			loading.set_value(move(loaded));
+		} catch(...) {
+			loading.set_exception(current_exception());
+
+			// the failure is only passed to the requests that waited for this load, the next one tries again
+			lock_guard<mutex> lock(m_cache_mutex);
+			auto it = m_machine_index.find(basename);
+			if(it != m_machine_index.end() && it->second->mtime_ns == mtime_ns && it->second->size == size) {
+				m_machines.erase(it->second);
+				m_machine_index.erase(it);
+			}
+		}
+	}
+	return cached.get(); // throws what the load threw
+}
+
+auto Server::execute(const string& line) -> string {
+	vector<string_view> tokens;
+	Utils::split(line, DELIM, tokens);
+
+	try {
+		if(tokens.size() < 2 || tokens.size() > 5) {
+			throw runtime_error("Server: Invalid run request: " + line);
+		}
+		string mem = tokens.size() >= 3 ? string(tokens[2]) : string(1, ZERO_CHAR);
+		size_t head_pos = tokens.size() >= 4 ? stoul(string(tokens[3])) : 0;
+		size_t max_steps = tokens.size() >= 5 ? stoul(string(tokens[4])) : DEFAULT_SERVER_STEPS;
+		if(mem.empty() || head_pos >= mem.size()) {
+			throw runtime_error("Server: Head position outside of memory");
+		}
+
+		Machine m = machine(string(tokens[1]));
+		CachedResult result;
+		if(!m_results || !m_results->find(m.table_hash, mem, head_pos, max_steps, result)) {
+			Executor e(m.table);
+			e.setMem(mem);
+			e.setHeadPos(head_pos);
+
+			auto start_time = chrono::steady_clock::now();
+			try {
+				result.steps = e.run(max_steps);
+				result.halted = result.steps > 0 && e.done();
+			} catch(runtime_error& err) {
+				result.error = err.what();
+			}
+			auto elapsed = chrono::steady_clock::now() - start_time;
+			m_busy_ns += static_cast<size_t>(chrono::duration_cast<chrono::nanoseconds>(elapsed).count());
+			m_steps += result.steps;
+
+			result.state = e.state();
+			result.mem = e.mem();
+			result.head_pos = e.headPos();
+			if(m_results) m_results->insert(m.table_hash, mem, head_pos, max_steps, result);
+		}
+
+		if(!result.error.empty()) throw runtime_error(result.error);
+		++m_completed;
+		return "ok " + result.state + ' ' + result.mem + ' ' + to_string(result.head_pos) + ' ' + to_string(result.steps)
+			   + (result.halted ? " halted" : " budget");
+	} catch(exception& err) { // stoul throws invalid_argument and out_of_range
+		++m_failed;
+		return string("error ") + err.what();
+	}
+}
+
+auto Server::stats() -> string {
+	size_t queue_depth = 0;
+	{
+		lock_guard<mutex> lock(m_queue_mutex);
+		queue_depth = m_queue.size();
+	}
+	size_t machines = 0;
+	{
+		lock_guard<mutex> lock(m_cache_mutex);
+		machines = m_machines.size();
+	}
+	size_t connections = 0;
+	{
+		lock_guard<mutex> lock(m_connection_mutex);
+		connections = m_open_connections;
+	}
+	auto uptime = chrono::duration_cast<chrono::seconds>(chrono::steady_clock::now() - m_start).count();
+	size_t busy_ns = m_busy_ns;
+	size_t steps = m_steps;
+
+	return "stats requests=" + to_string(m_requests) + " completed=" + to_string(m_completed) + " failed=" + to_string(m_failed)
+		   + " queue=" + to_string(queue_depth) + " workers=" + to_string(m_worker_count) + " connections=" + to_string(connections)
+		   + " machines=" + to_string(machines) + " cache_hits=" + to_string(m_cache_hits) + " cache_misses=" + to_string(m_cache_misses)
+		   + " steps=" + to_string(steps) + " steps_per_s=" + to_string(busy_ns > 0 ? static_cast<size_t>(static_cast<double>(steps) * 1e9 / static_cast<double>(busy_ns)) : 0)
+		   + (m_results ? " result_hits=" + to_string(m_results->hits()) + " result_misses=" + to_string(m_results->misses())
+			  + " saved_steps=" + to_string(m_results->saved_steps()) + " results=" + to_string(m_results->size()) : "")
+		   + " uptime_s=" + to_string(uptime);
+}
+
+void Server::deliver(Connection& connection, size_t seq, string answer) {
+	lock_guard<mutex> lock(connection.mutex);
+	connection.pending.emplace(seq, move(answer));
+
+	// send everything that is in order now with one write
+	string out;
+	for(auto it = connection.pending.begin(); it != connection.pending.end() && it->first == connection.next_seq; ) {
+		out += it->second;
+		out.push_back('\n');
+		it = connection.pending.erase(it);
+		++connection.next_seq;
+	}
+	if(!out.empty()) Utils::sendAll(connection.fd, out);
+}
+
+void Server::serve(shared_ptr<Connection> connection) {
+	string buffer;
+	char chunk[1 << 16];
+	size_t seq = 0;
+	bool too_long = false;
+
+	while(!too_long) {
+		ssize_t count = ::read(connection->fd, chunk, sizeof(chunk));
+		if(count <= 0) break;
+		buffer.append(chunk, static_cast<size_t>(count));
+
+		size_t begin = 0;
+		for(size_t end = buffer.find('\n'); end != string::npos; end = buffer.find('\n', begin)) {
+			if(end - begin > MAX_REQUEST_LINE) break;
+			string line = buffer.substr(begin, end - begin);
+			begin = end + 1;
+			if(!line.empty() && line.back() == '\r') line.pop_back();
+			if(line.empty()) continue;
+
+			++m_requests;
+			if(line == "stats") {
+				deliver(*connection, seq++, stats());
+			} else if(line == "shutdown") {
+				deliver(*connection, seq++, "ok shutdown");
+				stop();
+			} else if(line.compare(0, 4, "run ") == 0) {
+				lock_guard<mutex> lock(m_queue_mutex);
+				m_queue.push_back({connection, seq++, move(line)});
+				m_queue_cv.notify_one();
+			} else {
+				++m_failed;
+				deliver(*connection, seq++, "error Server: Unknown request " + line);
+			}
+		}
+		buffer.erase(0, begin);
+
+		// the rest of the line is never read, so the connection can't continue after it
+		too_long = min(buffer.find('\n'), buffer.size()) > MAX_REQUEST_LINE;
+		if(too_long) {
+			++m_requests;
+			++m_failed;
+			deliver(*connection, seq++, "error Server: Request line longer than " + to_string(MAX_REQUEST_LINE) + " bytes");
+		}
+	}
+
+	lock_guard<mutex> lock(m_connection_mutex);
+	--m_open_connections;
+	m_finished_readers.push_back(this_thread::get_id());
+	m_connection_cv.notify_all();
+}
+
+void Server::work() {
+	for(;;) {
+		Task task;
+		{
+			unique_lock<mutex> lock(m_queue_mutex);
+			m_queue_cv.wait(lock, [&] {return m_draining || !m_queue.empty();});
+			if(m_queue.empty()) return; // only when stopping
+			task = move(m_queue.front());
+			m_queue.pop_front();
+		}
+		deliver(*task.connection, task.seq, execute(task.line));
+	}
+}
+
+void Server::stop() {
+	// accept() fails from now on and the connections stop reading, answers are still sent
+	lock_guard<mutex> lock(m_connection_mutex);
+	m_stopping = true;
+	::shutdown(m_listen_fd, SHUT_RDWR);
+	for(auto& c : m_connections) {
+		if(auto connection = c.lock()) ::shutdown(connection->fd, SHUT_RD);
+	}
+}
+
+void Server::run() {
+	sockaddr_un address {};
+	address.sun_family = AF_UNIX;
+	if(m_socket_path.size() >= sizeof(address.sun_path)) {
+		throw runtime_error("Server: Socket path too long: " + m_socket_path);
+	}
+	strcpy(address.sun_path, m_socket_path.c_str());
+
+	m_listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	unlink(m_socket_path.c_str()); // left over from a server that didn't shut down
+	if(m_listen_fd < 0 || bind(m_listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(m_listen_fd, SOMAXCONN) != 0) {
+		throw runtime_error("Server: Could not listen on " + m_socket_path + ": " + strerror(errno));
+	}
+
+	vector<thread> workers;
+	for(size_t i=0; i<m_worker_count; ++i) {
+		workers.emplace_back(&Server::work, this);
+	}
+
+	int accept_error = 0;
+	for(;;) {
+		int fd = accept(m_listen_fd, nullptr, nullptr);
+		const int error = errno;
+		unique_lock<mutex> lock(m_connection_mutex);
+		if(m_stopping) {
+			if(fd >= 0) close(fd);
+			break;
+		}
+		// readers that are done only have to return, joining them doesn't wait for a connection
+		for(auto id : m_finished_readers) {
+			m_readers[id].join();
+			m_readers.erase(id);
+		}
+		m_finished_readers.clear();
+
+		if(fd < 0) {
+			lock.unlock();
+			if(error == EMFILE || error == ENFILE || error == ENOBUFS || error == ENOMEM) {
+				// retrying right away would spin until a connection closes and frees its descriptor
+				this_thread::sleep_for(ACCEPT_BACKOFF);
+			} else if(error != EINTR && error != ECONNABORTED && error != EPROTO) {
+				// the listening socket is broken, answer what has been received and quit
+				accept_error = error;
+				stop();
+				break;
+			}
+			continue;
+		}
+
+		auto connection = make_shared<Connection>(fd);
+		m_connections.erase(remove_if(m_connections.begin(), m_connections.end(), [](auto& c) {return c.expired();}), m_connections.end());
+		m_connections.push_back(connection);
+		++m_open_connections;
+		thread reader(&Server::serve, this, connection);
+		m_readers.emplace(reader.get_id(), move(reader));
+	}
+
+	// let the readers finish, then the workers empty the queue
+	unordered_map<thread::id, thread> readers;
+	{
+		unique_lock<mutex> lock(m_connection_mutex);
+		m_connection_cv.wait(lock, [&] {return m_open_connections == 0;});
+		readers = move(m_readers);
+		m_finished_readers.clear();
+	}
+	for(auto& reader : readers) reader.second.join();
+	{
+		lock_guard<mutex> lock(m_queue_mutex);
+		m_draining = true;
+		m_queue_cv.notify_all();
+	}
+	for(auto& worker : workers) worker.join();
+
+	close(m_listen_fd);
+	unlink(m_socket_path.c_str());
+	if(m_results) m_results->save();
+	if(accept_error != 0) {
+		throw runtime_error("Server: Could not accept connections: " + string(strerror(accept_error)));
+	}
+}
@@ -0,0 +1,113 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "resultcache.h"
+#include "table.h"
+
+static constexpr size_t DEFAULT_MACHINE_CACHE = 64;
+static constexpr size_t DEFAULT_SERVER_STEPS = 100000000; // budget of run requests that don't set one
+static constexpr size_t MAX_REQUEST_LINE = 1 << 20; // longer requests are answered with an error and end the connection
+static constexpr std::chrono::milliseconds ACCEPT_BACKOFF {100}; // wait after accept() ran out of descriptors or memory
+
+/*
+ * Executes run requests that arrive on a Unix domain socket, one request per line:
+ * run <machine> [memory] [head position] [max steps] -> ok <state> <memory> <head position> <steps> <halted | budget>
+ * stats -> stats <name>=<value>...
+ * shutdown -> ok shutdown
+ * Failures are answered with "error <message>". Requests can be pipelined, the
+ * answers of a connection come back in request order. Compiled machines are kept
+ * in an LRU cache keyed by path, modification time and size, so only the first
+ * request of a machine pays for reading and preparing it, requests that arrive
+ * while it is loaded wait for that load. With a result cache,
+ * runs that have been done before are answered without executing them.
+ */
+class Server {
+	struct Connection {
+		int fd;
+		std::mutex mutex {};
+		size_t next_seq = 0; // next answer to send
+		std::map<size_t, std::string> pending {}; // answers that wait for earlier ones
+
+		explicit Connection(int _fd) : fd(_fd) {}
+		~Connection();
+	};
+
+	struct Task {
+		std::shared_ptr<Connection> connection;
+		size_t seq;
+		std::string line;
+	};
+
+	struct Machine {
+		std::shared_ptr<const Table> table;
+		std::string table_hash; // only computed with a result cache
+	};
+
+	struct CachedMachine {
+		std::string path;
+		long long mtime_ns;
+		long long size;
+		std::shared_future<Machine> machine; // ready once the request that missed has loaded it
+	};
+
+	std::string m_socket_path;
+	size_t m_worker_count;
+	size_t m_cache_capacity;
+	int m_listen_fd = -1;
+	std::chrono::steady_clock::time_point m_start;
+
+	std::mutex m_queue_mutex {};
+	std::condition_variable m_queue_cv {};
+	std::deque<Task> m_queue {};
+	bool m_draining = false; // workers return once the queue is empty
+
+	std::mutex m_cache_mutex {};
+	std::list<CachedMachine> m_machines {}; // most recently used first
+	std::unordered_map<std::string, std::list<CachedMachine>::iterator> m_machine_index {};
+
+	std::mutex m_connection_mutex {};
+	std::condition_variable m_connection_cv {};
+	std::vector<std::weak_ptr<Connection>> m_connections {};
+	size_t m_open_connections = 0; // connections that are still read from
+	std::unordered_map<std::thread::id, std::thread> m_readers {};
+	std::vector<std::thread::id> m_finished_readers {}; // joined by the accepting thread
+	bool m_stopping = false;
+
+	std::atomic<size_t> m_requests {0};
+	std::atomic<size_t> m_completed {0};
+	std::atomic<size_t> m_failed {0};
+	std::atomic<size_t> m_steps {0};
+	std::atomic<size_t> m_busy_ns {0}; // time spent executing, summed over all workers
+	std::atomic<size_t> m_cache_hits {0};
+	std::atomic<size_t> m_cache_misses {0};
+	std::unique_ptr<ResultCache> m_results {};
+
+	auto machine(const std::string& path) -> Machine;
+	auto execute(const std::string& line) -> std::string;
+	auto stats() -> std::string;
+	void serve(std::shared_ptr<Connection> connection);
+	void work();
+	void stop();
+	static void deliver(Connection& connection, size_t seq, std::string answer);
+
+public:
+	explicit Server(std::string socket_path, size_t workers = 0, size_t cache_capacity = DEFAULT_MACHINE_CACHE, const std::string& result_cache = "");
+
+	// serves requests until a shutdown request arrives, throws if accepting connections fails for good
+	void run();
+};
+
+#endif // SERVER_H
@@ -0,0 +1,124 @@
+#ifndef STATICEXECUTOR_H
+#define STATICEXECUTOR_H
+
+/*
+ * Header-only executor for machines that were emitted as C++ headers by the
+ * compiler. Everything about the machine is a compile time constant, so this
+ * file has no dependencies on the rest of AQUA and can be copied into other
+ * projects together with the generated machine headers.
+ *
+ * A machine is a type with the following static constexpr members:
+ *   State          smallest unsigned integer type that can hold state_count
+ *   state_count    number of states, also used as "no rule" marker
+ *   alphabet       the tape characters, indexed by symbol code
+ *   start_state
+ *   end_states[]
+ *   state_names[]
+ *   transitions[]  state_count * symbol_count entries, indexed by state * symbol_count + symbol code
+ */
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+template<size_t N>
+using StaticStateType = std::conditional_t<(N <= UINT8_MAX), uint8_t,
+						std::conditional_t<(N <= UINT16_MAX), uint16_t, uint32_t>>;
+
+template<typename State>
+struct StaticTransition {
+	State new_state;
+	char new_char;
+	int8_t move; // -1, 0 or 1
+};
+
+template<typename Machine>
+class StaticExecutor {
+public:
+	using State = typename Machine::State;
+
+private:
+	static constexpr size_t symbol_count = sizeof(Machine::alphabet) - 1; // alphabet is a string literal
+	static constexpr char blank = Machine::alphabet[0];
+
+	static constexpr auto makeCodes() -> std::array<int16_t, 256> {
+		std::array<int16_t, 256> codes {};
+		for(auto& c : codes) c = -1;
+		for(size_t i=0; i<symbol_count; ++i) {
+			codes[static_cast<unsigned char>(Machine::alphabet[i])] = static_cast<int16_t>(i);
+		}
+		return codes;
+	}
+	static constexpr std::array<int16_t, 256> codes = makeCodes();
+
+	template<size_t... I>
+	static constexpr auto isEndState(State state, std::index_sequence<I...> /*unused*/) -> bool {
+		return ((state == Machine::end_states[I]) || ...);
+	}
+
+	State m_state = Machine::start_state;
+	std::string m_mem {};
+	size_t m_head_pos = 0;
+
+public:
+	explicit StaticExecutor(std::string mem = std::string(1, blank), size_t head_pos = 0) : m_mem(std::move(mem)), m_head_pos(head_pos) {
+		if(m_mem.empty()) m_mem.push_back(blank);
+	}
+
+	static constexpr auto isEndState(State state) -> bool {
+		return isEndState(state, std::make_index_sequence<std::size(Machine::end_states)>());
+	}
+
+	auto state() const -> State {return m_state;}
+	auto stateName() const -> const char* {return Machine::state_names[m_state];}
+	auto mem() const -> const std::string& {return m_mem;}
+	auto headPos() const -> size_t {return m_head_pos;}
+
+	// returns false once an end state has been reached, just like Executor::step
+	auto step() -> bool {
+		char& cell = m_mem[m_head_pos];
+		int16_t code = codes[static_cast<unsigned char>(cell)];
+		if(code < 0) {
+			throw std::runtime_error(std::string("StaticExecutor: Invalid char ") + cell);
+		}
+
+		const StaticTransition<State>& t = Machine::transitions[static_cast<size_t>(m_state) * symbol_count + static_cast<size_t>(code)];
+		if(t.new_state == Machine::state_count) {
+			throw std::runtime_error(std::string("StaticExecutor: No rule found for state ") + stateName() + " and char " + cell);
+		}
+
+		m_state = t.new_state;
+		cell = t.new_char;
+		if(t.move < 0) {
+			if(m_head_pos == 0) {
+				m_mem.insert(m_mem.begin(), blank);
+			} else {
+				--m_head_pos;
+			}
+		}
+		else if(t.move > 0) {
+			++m_head_pos;
+			if(m_head_pos == m_mem.size()) {
+				m_mem.push_back(blank);
+			}
+		}
+
+		return !isEndState(m_state);
+	}
+
+	// executes at most max_steps steps and returns how many were taken
+	auto run(size_t max_steps = SIZE_MAX) -> size_t {
+		size_t steps = 0;
+		while(steps < max_steps) {
+			++steps;
+			if(!step()) break;
+		}
+		return steps;
+	}
+};
+
+#endif // STATICEXECUTOR_H
@@ -0,0 +1,445 @@
+#include "stress.h"
+#include "executor.h"
+#include "blockexecutor.h"
+#include "compiler.h"
+#include "module.h"
+#include "table.h"
+#include "utils.h"
+#include "globals.h"
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <streambuf>
+using namespace std;
+
+static constexpr size_t MEMORIES_PER_CASE = 8;
+static constexpr size_t MAX_MEMORY_LENGTH = 16;
+static constexpr size_t SMALL_BATCH_LANES = 4; // fewer than the jobs of a case, so lanes get refilled
+static constexpr size_t SMALL_BATCH_TAPE = 32; // small enough that heads reach the edge and jobs fall back
+static constexpr size_t UNOPTIMIZED_STEP_FACTOR = 8; // NOP rules that were not merged cost extra steps
+
+// block size and cache capacity, tiny caches are flushed all the time
+static const vector<pair<size_t, size_t>> BLOCK_CONFIGS = {{1, 16}, {3, 64}, {DEFAULT_BLOCK_SIZE, DEFAULT_BLOCK_CACHE}};
+
+static const vector<pair<string, uint>> LEVELS = {
+	{"all passes", OPT_ALL},
+	{"no passes", OPT_NONE},
+	{"no slicing", OPT_ALL & ~OPT_SLICE},
+	{"no NOPtimizer", OPT_ALL & ~OPT_NOP},
+	{"no erasing", OPT_ALL & ~OPT_ERASE}
+};
+
+// swallows the trace that Executor::step prints
+class NullBuffer : public streambuf {
+protected:
+	auto overflow(int c) -> int override {return c;}
+};
+
+Stress::Stress(string mod_path, uint64_t seed, size_t max_steps) : m_mod_path(move(mod_path)), m_generator(seed), m_max_steps(max_steps) {
+	if(!m_mod_path.empty() && m_mod_path.back() != '/') m_mod_path += '/';
+	m_work_dir = (filesystem::temp_directory_path() / ("aqua-stress-" + to_string(getpid()))).string();
+	filesystem::create_directories(m_work_dir);
+
+	// every compiled module of the library can be called by random programs
+	vector<string> names;
+	for(auto& entry : filesystem::directory_iterator(m_mod_path.empty() ? "." : m_mod_path)) {
+		if(entry.path().extension() == AQUA_COMPILED_EXT) names.push_back(entry.path().stem().string());
+	}
+	sort(names.begin(), names.end());
+	for(auto& name : names) {
+		Module module(name, m_mod_path);
+		m_modules.push_back({name, {}});
+		for(uint32_t es : module.end_states()) {
+			m_modules.back().end_states.emplace_back(module.state(es));
+		}
+	}
+	if(m_modules.empty()) {
+		throw runtime_error("Stress: No modules found in " + m_mod_path);
+	}
+
+	for(auto isa : {BATCH_SCALAR, BATCH_AVX2, BATCH_AVX512}) {
+		if(isa <= BatchExecutor::bestIsa()) m_isas.push_back(isa);
+	}
+
+	m_engines.push_back({"step"});
+	m_engines.push_back({"run"});
+	m_engines.push_back({"run unfused"});
+	for(auto& config : BLOCK_CONFIGS) {
+		m_engines.push_back({"block " + to_string(config.first) + "/" + to_string(config.second)});
+	}
+	for(auto isa : m_isas) {
+		m_engines.push_back({string("batch ") + BatchExecutor::isaName(isa)});
+	}
+	m_engines.push_back({string("batch ") + BatchExecutor::isaName(BatchExecutor::bestIsa()) + " wide"});
+
+	for(auto& level : LEVELS) {
+		m_levels.push_back({level.first});
+	}
+}
+
+Stress::~Stress() {
+	error_code ignored;
+	filesystem::remove_all(m_work_dir, ignored);
+}
+
+auto Stress::same(const Outcome& a, const Outcome& b) -> bool {
+	// faulting engines stop at the same step, but not all of them count it
+	return a.fault == b.fault && a.state == b.state && a.mem == b.mem && a.head_pos == b.head_pos && (a.fault || (a.steps == b.steps && a.halted == b.halted));
+}
+
+auto Stress::describe(const Outcome& o) -> string {
+	if(o.fault) return "fault in state " + o.state + ", memory " + o.mem + ", head " + to_string(o.head_pos);
+	return "state " + o.state + ", memory " + o.mem + ", head " + to_string(o.head_pos) + ", " + to_string(o.steps) + " steps"
+		   + (o.halted ? ", halted" : ", out of steps");
+}
+
+auto Stress::signature(const string& description) -> string {
+	return description.substr(0, description.find(EXPLICIT_STATE));
+}
+
+auto Stress::alphabetOf(const vector<string>& lines) -> string {
+	string alphabet = DEFAULT_ALPHABET;
+	const string action = string(1, ACTION_CHAR) + ALPHABET_STRING + DELIM;
+	for(auto& line : lines) {
+		if(line.compare(0, action.size(), action) == 0) Module::extendAlphabet(alphabet, line.substr(action.size()));
+	}
+	return alphabet;
+}
+
+auto Stress::headerIndex(const vector<string>& lines) -> size_t {
+	for(size_t i=0; i<lines.size(); ++i) {
+		if(!lines[i].empty() && lines[i][0] != ACTION_CHAR && lines[i][0] != COMMENT_CHAR) return i;
+	}
+	return lines.size();
+}
+
+auto Stress::compareEngines(const vector<string>& table, const vector<BatchJob>& jobs, bool record, size_t& failing_job) -> string {
+	const string path = m_work_dir + "/table";
+	Utils::writeFile(path + AQUA_COMPILED_EXT, table);
+	unique_ptr<Module> module;
+	try {
+		module = make_unique<Module>(path);
+	} catch(runtime_error& err) {
+		failing_job = 0;
+		return string("load: ") + err.what();
+	}
+	auto unfused = make_shared<const Table>(*module);
+	auto fused = Executor::prepare(*module);
+
+	size_t engine = 0;
+	vector<Outcome> expected(jobs.size());
+	vector<Outcome> outcomes(jobs.size());
+	string mismatch;
+
+	// times one engine over all jobs, then compares its outcomes with the single steps
+	auto measure = [&](const function<void(vector<Outcome>&)>& body) {
+		vector<Outcome>& target = engine == 0 ? expected : outcomes;
+		auto start_time = chrono::steady_clock::now();
+		body(target);
+		auto elapsed = chrono::steady_clock::now() - start_time;
+
+		Stats& stats = m_engines[engine];
+		for(size_t j=0; j<jobs.size(); ++j) {
+			if(engine > 0 && !same(expected[j], target[j])) {
+				if(record) ++stats.mismatches;
+				if(mismatch.empty()) {
+					failing_job = j;
+					mismatch = stats.name + ": expected " + describe(expected[j]) + ", got " + describe(target[j]);
+				}
+			}
+			if(record && !target[j].fault) stats.steps += target[j].steps;
+		}
+		if(record) {
+			stats.runs += jobs.size();
+			stats.seconds += chrono::duration<double>(elapsed).count();
+		}
+		++engine;
+	};
+
+	// runs an Executor like object until it halts, faults or runs out of steps
+	auto execute = [&](auto& e, const BatchJob& job, Outcome& o, auto&& run) {
+		e.setMem(job.mem);
+		e.setHeadPos(job.head_pos);
+		try {
+			o.steps = run();
+		} catch(runtime_error&) {
+			o.fault = true;
+		}
+		o.halted = !o.fault && o.steps > 0 && e.done();
+		o.state = e.state();
+		o.mem = e.mem();
+		o.head_pos = e.headPos();
+	};
+
+	measure([&](vector<Outcome>& target) {
+		NullBuffer null;
+		streambuf* original = cout.rdbuf(&null);
+		for(size_t j=0; j<jobs.size(); ++j) {
+			Executor e(unfused);
+			execute(e, jobs[j], target[j], [&] {
+				size_t steps = 0;
+				while(steps < jobs[j].max_steps) {
+					++steps;
+					if(!e.step()) break;
+				}
+				return steps;
+			});
+		}
+		cout.rdbuf(original);
+	});
+
+	for(auto& table_ptr : {fused, unfused}) {
+		measure([&](vector<Outcome>& target) {
+			for(size_t j=0; j<jobs.size(); ++j) {
+				Executor e(table_ptr);
+				execute(e, jobs[j], target[j], [&] {return e.run(jobs[j].max_steps);});
+			}
+		});
+	}
+
+	for(auto& config : BLOCK_CONFIGS) {
+		measure([&](vector<Outcome>& target) {
+			BlockExecutor be(*module, config.first, config.second); // shared by all jobs, like its cache
+			for(size_t j=0; j<jobs.size(); ++j) {
+				be.setState(unfused->state_names()[unfused->start_state()]);
+				execute(be, jobs[j], target[j], [&] {return be.run(jobs[j].max_steps);});
+			}
+		});
+	}
+
+	auto batch = [&](BatchExecutor& be) {
+		measure([&](vector<Outcome>& target) {
+			vector<BatchResult> results;
+			be.run(jobs, results);
+			for(size_t j=0; j<jobs.size(); ++j) {
+				target[j] = {results[j].state, results[j].mem, results[j].head_pos, results[j].steps, results[j].halted, !results[j].error.empty()};
+			}
+		});
+	};
+	for(auto isa : m_isas) {
+		BatchExecutor be(*module, SMALL_BATCH_LANES, SMALL_BATCH_TAPE);
+		be.setIsa(isa);
+		batch(be);
+	}
+	BatchExecutor wide(*module);
+	batch(wide);
+
+	return mismatch;
+}
+
+auto Stress::compareLevels(const vector<string>& source, const vector<BatchJob>& jobs, bool record, size_t& failing_job,
+						   vector<string>& compiled) -> string {
+	const string source_path = m_work_dir + "/program" + AQUA_SOURCE_EXT;
+	Utils::writeFile(source_path, source);
+	failing_job = 0;
+
+	vector<Outcome> expected(jobs.size());
+	for(size_t level=0; level<LEVELS.size(); ++level) {
+		Stats& stats = m_levels[level];
+		vector<string> result;
+		try {
+			Compiler::compile(source_path, result, m_mod_path, 0, nullptr, LEVELS[level].second);
+		} catch(runtime_error& err) {
+			return (level == 0 ? string("compile") : "compile " + stats.name) + ": " + err.what();
+		}
+		if(level == 0) compiled = result;
+
+		const string path = m_work_dir + "/level" + to_string(level);
+		Utils::writeFile(path + AQUA_COMPILED_EXT, result);
+		Module module(path);
+		auto table = Executor::prepare(module);
+
+		// the step counts differ between the levels, only the end of a run has to be the same
+		const size_t factor = level == 0 ? 1 : UNOPTIMIZED_STEP_FACTOR;
+		auto start_time = chrono::steady_clock::now();
+		vector<Outcome> outcomes(jobs.size());
+		for(size_t j=0; j<jobs.size(); ++j) {
+			Executor e(table);
+			e.setMem(jobs[j].mem);
+			e.setHeadPos(jobs[j].head_pos);
+			Outcome& o = outcomes[j];
+			try {
+				o.steps = e.run(jobs[j].max_steps == SIZE_MAX ? SIZE_MAX : jobs[j].max_steps * factor);
+			} catch(runtime_error&) {
+				o.fault = true;
+			}
+			o.state = e.done() ? e.state() : "";
+			o.mem = e.mem();
+			o.head_pos = e.headPos();
+			if(record && !o.fault) stats.steps += o.steps;
+		}
+		auto elapsed = chrono::steady_clock::now() - start_time;
+		if(record) {
+			stats.runs += jobs.size();
+			stats.seconds += chrono::duration<double>(elapsed).count();
+		}
+
+		if(level == 0) {
+			expected = outcomes;
+			continue;
+		}
+		for(size_t j=0; j<jobs.size(); ++j) {
+			const Outcome& want = expected[j];
+			const Outcome& got = outcomes[j];
+			bool halted = !want.fault && !want.state.empty();
+			bool ok = true;
+			if(want.fault) ok = got.fault; // the faulting state has different names or is merged away
+			else if(halted) ok = !got.fault && got.state == want.state && got.mem == want.mem && got.head_pos == want.head_pos;
+			if(ok) continue;
+
+			if(record) ++stats.mismatches;
+			failing_job = j;
+			return stats.name + ": expected " + (want.fault ? "a fault" : describe(want)) + ", got "
+				   + (got.fault ? "a fault" : got.state.empty() ? "no end within " + to_string(got.steps) + " steps" : describe(got));
+		}
+	}
+	return "";
+}
+
+auto Stress::check(const vector<string>& lines, bool program, const vector<BatchJob>& jobs, bool record, Failure& failure) -> bool {
+	size_t failing_job = 0;
+	vector<string> table = lines;
+	if(program) {
+		failure.description = compareLevels(lines, jobs, record, failing_job, table);
+		if(!failure.description.empty()) {
+			failure = {failure.description, lines, true, jobs[failing_job]};
+			return false;
+		}
+	}
+
+	// compiled programs are good test machines for the engines too
+	failure.description = compareEngines(table, jobs, record, failing_job);
+	if(!failure.description.empty()) {
+		failure = {failure.description, table, false, jobs[failing_job]};
+		return false;
+	}
+	return true;
+}
+
+void Stress::minimize(Failure& failure) {
+	const string kind = signature(failure.description);
+	if(kind == "compile" || kind == "load") return; // any broken input would still fail
+
+	auto reproduces = [&](const vector<string>& lines, const BatchJob& job) {
+		Failure candidate;
+		if(check(lines, failure.program, {job}, false, candidate)) return false;
+		if(candidate.program != failure.program || signature(candidate.description) != kind) return false;
+		failure.description = candidate.description;
+		return true;
+	};
+
+	bool progress = true;
+	while(progress) {
+		progress = false;
+
+		// whole lines, except the state header
+		const size_t header = headerIndex(failure.lines);
+		for(size_t i=failure.lines.size(); i-- > 0;) {
+			if(i == header || failure.lines[i].empty()) continue;
+			vector<string> candidate = failure.lines;
+			candidate.erase(candidate.begin() + static_cast<long>(i));
+			if(reproduces(candidate, failure.job)) {
+				failure.lines = move(candidate);
+				progress = true;
+			}
+		}
+
+		// single tokens of program lines, they all end with whitespace
+		for(size_t i=headerIndex(failure.lines) + 1; failure.program && i<failure.lines.size(); ++i) {
+			vector<string_view> views;
+			Utils::split(failure.lines[i], DELIM, views);
+			vector<string> tokens;
+			for(auto view : views) {
+				if(!view.empty()) tokens.emplace_back(view);
+			}
+			for(size_t t=tokens.size(); t-- > 0;) {
+				// the move after a label keeps jumps from forming NOP cycles, the compiler would never finish
+				if(t == 1 && tokens[0].back() == EXPLICIT_STATE) continue;
+				string line;
+				for(size_t k=0; k<tokens.size(); ++k) {
+					if(k != t) line += tokens[k] + DELIM;
+				}
+				vector<string> candidate = failure.lines;
+				candidate[i] = line;
+				if(reproduces(candidate, failure.job)) {
+					failure.lines = move(candidate);
+					tokens.erase(tokens.begin() + static_cast<long>(t));
+					progress = true;
+				}
+			}
+		}
+
+		// cells of the memory, then the symbols in them
+		for(size_t k=failure.job.mem.size(); k-- > 0 && failure.job.mem.size() > 1;) {
+			BatchJob candidate = failure.job;
+			candidate.mem.erase(k, 1);
+			if(k < candidate.head_pos || candidate.head_pos == candidate.mem.size()) --candidate.head_pos;
+			if(reproduces(failure.lines, candidate)) {
+				failure.job = move(candidate);
+				progress = true;
+			}
+		}
+		for(size_t k=0; k<failure.job.mem.size(); ++k) {
+			if(failure.job.mem[k] == ZERO_CHAR) continue;
+			BatchJob candidate = failure.job;
+			candidate.mem[k] = ZERO_CHAR;
+			if(reproduces(failure.lines, candidate)) {
+				failure.job = move(candidate);
+				progress = true;
+			}
+		}
+	}
+}
+
+auto Stress::run(size_t cases, ostream& out) -> size_t {
+	size_t failures = 0;
+	for(size_t i=0; i<cases; ++i) {
+		++m_cases;
+		const bool program = i % 2 == 1;
+		vector<string> lines;
+		if(program) m_generator.program(m_modules, lines);
+		else m_generator.table(lines);
+
+		const string alphabet = alphabetOf(lines);
+		vector<BatchJob> jobs(MEMORIES_PER_CASE);
+		for(auto& job : jobs) {
+			m_generator.memory(alphabet, MAX_MEMORY_LENGTH, job.mem, job.head_pos);
+			job.max_steps = m_max_steps;
+		}
+
+		Failure failure;
+		if(check(lines, program, jobs, true, failure)) continue;
+		minimize(failure);
+
+		++failures;
+		++m_failures;
+		const string filename = "stress_failure_" + to_string(m_failures) + (failure.program ? AQUA_SOURCE_EXT : AQUA_COMPILED_EXT);
+		Utils::writeFile(filename, failure.lines);
+		out << FAULT_TEXT << "Case " << i << " failed: " << DEFAULT_TEXT << failure.description << '\n';
+		out << "Memory " << failure.job.mem << ", head " << failure.job.head_pos << ", " << failure.job.max_steps << " steps, machine written to "
+			<< INFO_TEXT << filename << DEFAULT_TEXT << endl;
+	}
+	return failures;
+}
+
+void Stress::report(ostream& out) const {
+	auto table = [&](const string& title, const vector<Stats>& rows) {
+		out << left << setw(20) << title << right << setw(8) << "runs" << setw(12) << "steps" << setw(10) << "seconds"
+			<< setw(14) << "steps/s" << setw(12) << "mismatches" << '\n';
+		for(auto& row : rows) {
+			out << left << setw(20) << row.name << right << setw(8) << row.runs << setw(12) << row.steps << setw(10) << fixed << setprecision(3)
+				<< row.seconds << setw(14) << (row.seconds > 0 ? static_cast<size_t>(static_cast<double>(row.steps) / row.seconds) : 0)
+				<< setw(12) << row.mismatches << '\n';
+		}
+	};
+	table("Engine", m_engines);
+	out << '\n';
+	table("Optimizations", m_levels);
+	out << '\n' << m_cases << " cases, " << (m_failures > 0 ? FAULT_TEXT : INFO_TEXT) << m_failures << " failed" << DEFAULT_TEXT << endl;
+}
@@ -0,0 +1,86 @@
+#ifndef STRESS_H
+#define STRESS_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "batchexecutor.h"
+#include "generator.h"
+
+static constexpr size_t DEFAULT_STRESS_CASES = 200;
+static constexpr size_t DEFAULT_STRESS_STEPS = 2000;
+
+/*
+ * Differential testing of everything that executes or compiles machines.
+ * Random tables run on every engine (single steps, fused and unfused run(),
+ * block executors with small and large blocks and caches, the batch executor
+ * with every supported instruction set) and must give identical results.
+ * Random programs are compiled with every combination of optimization passes,
+ * the machines must halt or fault alike. Failing cases are minimized and
+ * written to stress_failure_<n>.aquacomp or .aquasrc in the current directory.
+ */
+class Stress {
+	struct Outcome {
+		std::string state {};
+		std::string mem {};
+		size_t head_pos = 0;
+		size_t steps = 0;
+		bool halted = false;
+		bool fault = false;
+	};
+
+	struct Failure {
+		std::string description {}; // starts with the engine or optimization level and a colon
+		std::vector<std::string> lines {};
+		bool program = false;
+		BatchJob job {};
+	};
+
+	struct Stats {
+		std::string name;
+		size_t runs = 0;
+		size_t steps = 0;
+		size_t mismatches = 0;
+		double seconds = 0;
+	};
+
+	std::string m_mod_path;
+	std::string m_work_dir;
+	Generator m_generator;
+	size_t m_max_steps;
+	std::vector<ModuleInfo> m_modules {};
+	std::vector<BatchIsa> m_isas {};
+	std::vector<Stats> m_engines {};
+	std::vector<Stats> m_levels {}; // one per combination of compiler optimizations
+	size_t m_cases = 0;
+	size_t m_failures = 0;
+
+	static auto same(const Outcome& a, const Outcome& b) -> bool;
+	static auto describe(const Outcome& o) -> std::string;
+	static auto signature(const std::string& description) -> std::string;
+	static auto alphabetOf(const std::vector<std::string>& lines) -> std::string;
+	static auto headerIndex(const std::vector<std::string>& lines) -> size_t;
+
+	auto compareEngines(const std::vector<std::string>& table, const std::vector<BatchJob>& jobs, bool record, size_t& failing_job) -> std::string;
+	auto compareLevels(const std::vector<std::string>& source, const std::vector<BatchJob>& jobs, bool record, size_t& failing_job,
+					   std::vector<std::string>& compiled) -> std::string;
+	// true if the case passes, otherwise failure describes the first mismatch
+	auto check(const std::vector<std::string>& lines, bool program, const std::vector<BatchJob>& jobs, bool record, Failure& failure) -> bool;
+	// drops lines, tokens and memory cells as long as the same kind of mismatch remains
+	void minimize(Failure& failure);
+
+public:
+	// mod_path is the module library that random programs load their modules from
+	Stress(std::string mod_path, uint64_t seed, size_t max_steps = DEFAULT_STRESS_STEPS);
+	~Stress();
+	Stress(const Stress&) = delete;
+	auto operator=(const Stress&) -> Stress& = delete;
+
+	// runs as many cases, half tables and half programs, returns the number of failing ones
+	auto run(size_t cases, std::ostream& out) -> size_t;
+	// cases, steps and steps per second of each engine and optimization level
+	void report(std::ostream& out) const;
+};
+
+#endif // STRESS_H
@@ -0,0 +1,120 @@
+#include "table.h"
+#include "globals.h"
+#include <stdexcept>
+#include <algorithm>
+using namespace std;
+
+Table::Table(Module& module) {
+	m_alphabet = module.alphabet();
+	m_codes.fill(-1);
+	for(size_t i=0; i<m_alphabet.size(); ++i) {
+		m_codes[static_cast<unsigned char>(m_alphabet[i])] = static_cast<int>(i);
+	}
+
+	// number all states in order of appearance, the start state always gets 0
+	vector<uint32_t> indices(module.state_count(), NO_STATE);
+	auto index = [&](uint32_t state) -> uint32_t {
+		if(indices[state] == NO_STATE) indices[state] = addState(string(module.state(state)));
+		return indices[state];
+	};
+
+	m_start_state = index(module.start_state());
+	for(auto& r : module.rules()) {
+		index(r.old_state);
+		index(r.new_state);
+	}
+	for(uint32_t es : module.end_states()) {
+		m_end_states[index(es)] = true;
+	}
+
+	// fill the transition slots
+	m_transitions.resize(m_state_names.size() * m_alphabet.size());
+	for(auto& r : module.rules()) {
+		int old_code = code(r.old_char);
+		int new_code = code(r.new_char);
+		if(old_code < 0 || new_code < 0) {
+			throw runtime_error("Table: Character not in alphabet in rule of state " + string(module.state(r.old_state)));
+		}
+
+		Transition& t = m_transitions[indices[r.old_state] * m_alphabet.size() + static_cast<size_t>(old_code)];
+		if(t.new_state != NO_STATE) continue; // the first matching rule wins, just like in Executor::step
+		t.new_state = indices[r.new_state];
+		t.new_symbol = static_cast<uint8_t>(new_code);
+		t.dir = r.dir;
+	}
+}
+
+auto Table::addState(const string& name) -> uint32_t {
+	m_state_names.push_back(name);
+	m_end_states.push_back(false);
+	return static_cast<uint32_t>(m_state_names.size() - 1);
+}
+
+auto Table::isStraight(uint32_t state) const -> bool {
+	// every symbol must lead to the same state with the same move and either keep the symbol or write the same one
+	const Transition& first = at(state, 0);
+	if(first.new_state == NO_STATE || m_end_states[state]) return false;
+
+	bool keeps = first.new_symbol == 0;
+	bool writes = true;
+	for(size_t c=1; c<m_alphabet.size(); ++c) {
+		const Transition& t = at(state, static_cast<uint8_t>(c));
+		if(t.new_state != first.new_state || t.dir != first.dir) return false;
+		keeps = keeps && t.new_symbol == c;
+		writes = writes && t.new_symbol == first.new_symbol;
+	}
+	return keeps || writes;
+}
+
+void Table::fuse(size_t max_steps) {
+	m_fused.assign(m_state_names.size(), FusedTransition());
+	m_fused_writes.clear();
+	bool found = false;
+
+	for(uint32_t s=0; s<m_state_names.size(); ++s) {
+		if(!isStraight(s)) continue;
+
+		FusedTransition f;
+		f.writes_begin = m_fused_writes.size();
+		uint32_t current = s;
+		long offset = 0;
+
+		// follow the chain until it branches, ends, loops back or gets too long
+		do {
+			const Transition& t = at(current, 0);
+
+			// only constant writes are recorded, the last one to an offset wins
+			if(at(current, 1).new_symbol == t.new_symbol) {
+				auto w = m_fused_writes.begin() + static_cast<long>(f.writes_begin);
+				for(; w != m_fused_writes.end(); ++w) {
+					if(w->offset == offset) break;
+				}
+				if(w == m_fused_writes.end()) m_fused_writes.push_back({offset, t.new_symbol});
+				else w->new_symbol = t.new_symbol;
+			}
+
+			if(t.dir == LEFT) --offset;
+			else if(t.dir == RIGHT) ++offset;
+			f.min_offset = min(f.min_offset, offset);
+			f.max_offset = max(f.max_offset, offset);
+
+			++f.steps;
+			current = t.new_state;
+		} while(f.steps < max_steps && current != s && isStraight(current));
+
+		// a chain of one step is just a normal transition
+		if(f.steps < 2) {
+			m_fused_writes.resize(f.writes_begin);
+			continue;
+		}
+
+		f.new_state = current;
+		f.shift = offset;
+		f.writes_end = m_fused_writes.size();
+		m_fused[s] = f;
+		found = true;
+	}
+
+	// without chains hasFused() is false, so executors skip the lookup
+	if(!found) m_fused.clear();
+}
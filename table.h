@@ -0,0 +1,78 @@
+#ifndef TABLE_H
+#define TABLE_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "module.h"
+
+static constexpr uint32_t NO_STATE = UINT32_MAX;
+static constexpr size_t MAX_FUSED_STEPS = 64;
+
+struct Transition {
+	uint32_t new_state = NO_STATE; // NO_STATE marks a missing rule
+	uint8_t new_symbol = 0; // symbol code, not the tape character
+	MoveDir dir = NOP;
+};
+
+/*
+ * A straight-line chain of transitions that don't depend on the symbol under
+ * the head, applied as a whole: write the pattern, shift the head, change state.
+ * The head visits every offset in [min_offset, max_offset] on the way.
+ */
+struct FusedTransition {
+	uint32_t new_state = NO_STATE; // NO_STATE marks states that start no chain
+	size_t steps = 0;
+	long shift = 0;
+	long min_offset = 0;
+	long max_offset = 0;
+	size_t writes_begin = 0; // range in Table::fused_writes
+	size_t writes_end = 0;
+};
+
+struct FusedWrite {
+	long offset;
+	uint8_t new_symbol;
+};
+
+/*
+ * Dense form of a Module: states are numbered, tape characters are mapped to
+ * compact symbol codes and every (state, symbol) pair has exactly one slot.
+ */
+class Table {
+	std::vector<std::string> m_state_names {};
+	std::vector<bool> m_end_states {};
+	std::string m_alphabet {};
+	std::array<int, 256> m_codes {};
+	std::vector<Transition> m_transitions {};
+	std::vector<FusedTransition> m_fused {};
+	std::vector<FusedWrite> m_fused_writes {};
+	uint32_t m_start_state = 0;
+
+	auto addState(const std::string& name) -> uint32_t;
+	auto isStraight(uint32_t state) const -> bool;
+
+public:
+	explicit Table(Module& module);
+
+	// find all straight-line chains and store them as fused transitions
+	void fuse(size_t max_steps = MAX_FUSED_STEPS);
+
+	auto state_names() const -> const std::vector<std::string>& {return m_state_names;}
+	auto alphabet() const -> const std::string& {return m_alphabet;}
+	auto start_state() const -> uint32_t {return m_start_state;}
+	auto state_count() const -> size_t {return m_state_names.size();}
+	auto symbol_count() const -> size_t {return m_alphabet.size();}
+
+	auto isEndState(uint32_t state) const -> bool {return m_end_states[state];}
+	auto code(char c) const -> int {return m_codes[static_cast<unsigned char>(c)];}
+	auto symbol(uint8_t code) const -> char {return m_alphabet[code];}
+	auto at(uint32_t state, uint8_t code) const -> const Transition& {return m_transitions[state * m_alphabet.size() + code];}
+
+	auto hasFused() const -> bool {return !m_fused.empty();}
+	auto fused(uint32_t state) const -> const FusedTransition& {return m_fused[state];}
+	auto fused_writes() const -> const std::vector<FusedWrite>& {return m_fused_writes;}
+};
+
+#endif // TABLE_H
@@ -1,20 +1,22 @@
 #include "utils.h"
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <fstream>
+#include <algorithm>
+#include <cstdio>
 using namespace std;
 
-void Utils::split(const string& text, const string& delim, vector<string>& result) {
+void Utils::split(string_view text, char delim, vector<string_view>& result) {
 	size_t search_begin = 0;
 
 	result.clear();
 	while(true) {
-		size_t search_end = 0; // no scope redution to loop, we need to use this variable often
-		search_end = text.find_first_of(delim, search_begin);
-		if(search_end == string::npos) {
-			result.emplace_back(text.substr(search_begin, text.size() - search_begin));
+		size_t search_end = text.find(delim, search_begin);
+		if(search_end == string_view::npos) {
+			result.push_back(text.substr(search_begin));
 			return;
 		}
-		result.emplace_back(text.substr(search_begin, search_end - search_begin));
+		result.push_back(text.substr(search_begin, search_end - search_begin));
 		search_begin = search_end + 1;
 	}
 }
@@ -24,19 +26,39 @@ auto Utils::fileExists(const string& filename) -> bool {
 	return (stat(filename.c_str(), &buffer) == 0);
 }
 
-auto Utils::readFile(const std::string& filename, std::vector<std::string>& lines) -> bool {
-	if(!fileExists(filename)) return false;
-	ifstream file_in(filename);
-	char buf[BUFSIZ];
+auto Utils::readFile(const string& filename, string& buffer, vector<string_view>& lines) -> bool {
+	struct stat info {};
+	if(stat(filename.c_str(), &info) != 0) return false;
+
+	FILE* file_in = fopen(filename.c_str(), "rb");
+	if(file_in == nullptr) return false;
+
+	// read into one buffer, no per-line copies and no line length limit. regular files usually need one read,
+	// pipes and other special files report no size, the buffer grows until the end is reached
+	buffer.resize(max(static_cast<size_t>(info.st_size) + 1, size_t(1) << 12));
+	size_t size = 0;
+	for(;;) {
+		size += fread(buffer.data() + size, 1, buffer.size() - size, file_in);
+		if(size < buffer.size()) {
+			if(feof(file_in) || ferror(file_in)) break;
+			continue; // short read
+		}
+		buffer.resize(buffer.size() * 2);
+	}
+	bool failed = ferror(file_in) != 0;
+	fclose(file_in);
+	if(failed) return false;
+	buffer.resize(size);
 
 	lines.clear();
-	if(!file_in.good()) return false;
-	while(true) {
-		file_in.getline(static_cast<char*>(buf), BUFSIZ, '\n');
-		if(file_in.eof()) break;
-		lines.emplace_back(static_cast<char*>(buf));
+	lines.reserve(static_cast<size_t>(count(buffer.begin(), buffer.end(), '\n')) + 1);
+	string_view rest = buffer;
+	while(!rest.empty()) {
+		size_t end = rest.find('\n');
+		if(end == string_view::npos) end = rest.size();
+		lines.push_back(rest.substr(0, end));
+		rest.remove_prefix(min(end + 1, rest.size()));
 	}
-	file_in.close();
 	return true;
 }
 
@@ -48,5 +70,14 @@ auto Utils::writeFile(const std::string& filename, const std::vector<std::string
 		file_out.write((line + '\n').c_str(), static_cast<long>(line.size()+1));
 	}
 	file_out.close();
-	return false;
+	return !file_out.fail(); // also covers a failed flush on close
+}
+
+auto Utils::sendAll(int fd, string_view data) -> bool {
+	while(!data.empty()) {
+		ssize_t sent = send(fd, data.data(), data.size(), MSG_NOSIGNAL); // no SIGPIPE if the other side is gone
+		if(sent <= 0) return false;
+		data.remove_prefix(static_cast<size_t>(sent));
+	}
+	return true;
 }
@@ -2,14 +2,19 @@
 #define UTILS_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 
 class Utils {
 public:
-	static void split(const std::string& text, const std::string& delim, std::vector<std::string>& result);
+	// the tokens point into text, they stay valid as long as text does
+	static void split(std::string_view text, char delim, std::vector<std::string_view>& result);
 	static auto fileExists(const std::string& filename) -> bool;
-	static auto readFile(const std::string& filename, std::vector<std::string>& lines) -> bool;
+	// reads the whole file into buffer, the lines point into it and don't contain the line break
+	static auto readFile(const std::string& filename, std::string& buffer, std::vector<std::string_view>& lines) -> bool;
 	static auto writeFile(const std::string& filename, const std::vector<std::string>& lines) -> bool;
+	// writes all of data to a socket, returns false if the other side is gone
+	static auto sendAll(int fd, std::string_view data) -> bool;
 };
 
 #endif // UTILS_H